@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//latency of the mini-shell's own work, measured from outside: the shell reads
+//commands from a pipe, and after each one the harness sends "set", a builtin that
+//prints a line, and waits for it. stdout is a pty so that line is not held in
+//stdio's buffer. prints one tab separated line per case, in microseconds
+//
+//usage: latency <shell> [iterations]
+
+#define SENTINEL "pipesize="
+#define WARMUP 20
+
+typedef struct {
+  const char *name;
+  char *command;
+  int divisor; //long lines run fewer times
+} bench_case_t;
+
+static int to_shell = -1;   //shell's stdin
+static int from_shell = -1; //pty master, the shell's stdout
+static pid_t shell_pid;
+
+static void start_shell(const char *path)
+{
+  int input[2];
+  if(pipe(input) < 0)
+  {
+    perror("pipe");
+    exit(1);
+  }
+  from_shell = posix_openpt(O_RDWR | O_NOCTTY);
+  if(from_shell < 0 || grantpt(from_shell) < 0 || unlockpt(from_shell) < 0)
+  {
+    perror("pty");
+    exit(1);
+  }
+  int terminal = open(ptsname(from_shell), O_RDWR | O_NOCTTY);
+  struct termios mode;
+  tcgetattr(terminal, &mode);
+  cfmakeraw(&mode); //no echo or newline translation
+  tcsetattr(terminal, TCSANOW, &mode);
+
+  shell_pid = fork();
+  if(shell_pid < 0)
+  {
+    perror("fork");
+    exit(1);
+  }
+  if(shell_pid == 0)
+  {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(input[0], STDIN_FILENO);
+    dup2(terminal, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO); //command not found and the like
+    closefrom(STDERR_FILENO + 1);
+    execl(path, path, (char *)NULL);
+    _exit(127);
+  }
+  close(input[0]);
+  close(terminal);
+  to_shell = input[1];
+}
+
+static void send_all(const char *text, size_t length)
+{
+  while(length > 0)
+  {
+    ssize_t put = write(to_shell, text, length);
+    if(put < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      perror("write");
+      exit(1);
+    }
+    text += put;
+    length -= put;
+  }
+}
+
+//read the shell's output up to and including the sentinel line
+static void wait_sentinel()
+{
+  static char window[4096];
+  static size_t used = 0;
+  while(1)
+  {
+    char *found = memmem(window, used, SENTINEL, strlen(SENTINEL));
+    char *end = found != NULL ? memchr(found, '\n', used - (found - window)) : NULL;
+    if(end != NULL)
+    {
+      //keep what came after it
+      used -= end + 1 - window;
+      memmove(window, end + 1, used);
+      return;
+    }
+    if(used == sizeof(window))
+    {
+      //job notices and the like, keep only a tail that may hold a partial sentinel
+      memmove(window, window + used - 64, 64);
+      used = 64;
+    }
+    ssize_t got = read(from_shell, window + used, sizeof(window) - used);
+    if(got <= 0)
+    {
+      if(got < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      fprintf(stderr, "latency: the shell exited\n");
+      exit(1);
+    }
+    used += got;
+  }
+}
+
+static double now_us()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void run_case(const bench_case_t *bench, int iterations)
+{
+  //the command and the sentinel go in one write, as one script would have them
+  size_t length = strlen(bench->command) + strlen("\nset\n");
+  char *text = malloc(length + 1);
+  sprintf(text, "%s\nset\n", bench->command);
+
+  int runs = iterations / bench->divisor;
+  runs = runs > 0 ? runs : 1;
+  double *samples = malloc(sizeof(double) * runs);
+  for(int i = -WARMUP; i < runs; i ++)
+  {
+    double start = now_us();
+    send_all(text, length);
+    wait_sentinel();
+    if(i >= 0)
+    {
+      samples[i] = now_us() - start;
+    }
+  }
+
+  qsort(samples, runs, sizeof(double), compare_doubles);
+  double sum = 0;
+  for(int i = 0; i < runs; i ++)
+  {
+    sum += samples[i];
+  }
+  printf("%s\t%d\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n", bench->name, runs, sum / runs, samples[runs / 2],
+         samples[(int)(runs * 0.9)], samples[(int)(runs * 0.99)], samples[runs - 1]);
+  fflush(stdout);
+  free(samples);
+  free(text);
+}
+
+//first followed by count copies of piece
+static char* repeat(const char *first, const char *piece, int count)
+{
+  char *text = malloc(strlen(first) + strlen(piece) * count + 1);
+  char *p = stpcpy(text, first);
+  for(int i = 0; i < count; i ++)
+  {
+    p = stpcpy(p, piece);
+  }
+  return text;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: latency <shell> [iterations]\n");
+    return 2;
+  }
+  int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+  if(iterations <= 0)
+  {
+    fprintf(stderr, "latency: bad iteration count %s\n", argv[2]);
+    return 2;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  start_shell(argv[1]);
+
+  bench_case_t cases[] = {
+    {"sentinel", repeat("", "", 0), 1}, //just the set that follows every case
+    {"builtin", repeat("cd .", "", 0), 1},
+    {"external", repeat("true", "", 0), 1},
+    {"pipeline-4", repeat("true", " | true", 3), 1},
+    {"pipeline-16", repeat("true", " | true", 15), 2},
+    {"background", repeat("true &", "", 0), 1},
+    {"tokenize-5000-args", repeat("cd .", " x", 5000), 10}, //cd only looks at its first
+    {"dispatch-1000-seq", repeat("cd .", " ; cd .", 999), 10},
+    {"dispatch-1000-and-or", repeat("cd /nonexistent || cd .", " && cd /nonexistent || cd .", 499), 10},
+  };
+
+  printf("case\truns\tmean_us\tp50_us\tp90_us\tp99_us\tmax_us\n");
+  for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i ++)
+  {
+    run_case(&cases[i], iterations);
+    free(cases[i].command);
+  }
+
+  close(to_shell); //end of input, the shell exits
+  int status;
+  waitpid(shell_pid, &status, 0);
+  return 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Pipe throughput of the mini-shell: pushes a file through a 3 stage pipeline
+# with the external cat and with the shell's splice cat, at the default and a
+# large pipe size. Prints one tab separated line per case: name, bytes, seconds, MB/s
+#
+# usage: bench/throughput.sh [shell] [megabytes] [runs]
+SHELL_BIN=${1:-./bin/shell}
+MEGABYTES=${2:-512}
+RUNS=${3:-3}
+
+DATA=$(mktemp)
+trap 'rm -f "$DATA"' EXIT
+head -c $((MEGABYTES * 1048576)) /dev/urandom > "$DATA"
+BYTES=$(stat -c %s "$DATA")
+
+run_case()
+{
+    local name=$1 script=$2
+    local best=
+    for ((i = 0; i < RUNS; i++)); do
+        local start=$(date +%s%N)
+        "$SHELL_BIN" -c "$script" || exit 1
+        local elapsed=$(( $(date +%s%N) - start ))
+        if [[ -z $best || $elapsed -lt $best ]]; then
+            best=$elapsed
+        fi
+    done
+    awk -v n="$name" -v b="$BYTES" -v t="$best" \
+        'BEGIN { printf "%s\t%d\t%.3f\t%.1f\n", n, b, t / 1e9, b / 1048576 / (t / 1e9) }'
+}
+
+printf "case\tbytes\tseconds\tMB/s\n"
+run_case external-cat "/bin/cat < $DATA | /bin/cat | /bin/cat > /dev/null"
+run_case splice-cat "cat < $DATA | /bin/cat | cat > /dev/null"
+run_case external-cat-1m "set pipesize=1m
+/bin/cat < $DATA | /bin/cat | /bin/cat > /dev/null"
+run_case splice-cat-1m "set pipesize=1m
+cat < $DATA | /bin/cat | cat > /dev/null"
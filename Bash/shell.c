@@ -9,50 +9,213 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 //define constant variables
-#define BUFFER_SIZE 80
-#define MAX_TOKENS 128
-#define MAX_ARGS 64
-#define MAX_JOBS 5
-#define MAX_HISTORY 100
+#define MAX_TOKENS 128 //tokens and argv slots kept on the stack, longer lines use the heap
+#define MAX_ARGS 64    //pipeline stages kept on the stack, longer pipelines use the heap
+#define MAX_HISTORY 100 //default capacity, HISTSIZE overrides it
+#define HISTORY_INDEX_BUCKETS 4096
+#define HASH_BUCKETS 64
+#define INPUT_BLOCK 4096    //smallest read of typed input
+#define SCRIPT_BLOCK 65536  //smallest read of a script or piped input
+#define SPLICE_CHUNK (1 << 20) //most the cat stage moves per splice call
 #define JOB_RUNNING 0
 #define JOB_STOPPED 1
 #define JOB_DONE 2
 
+//one command of a pipeline, argv and file names point into the line's tokens
 typedef struct {
+    char **argv;
+    char *input_file;
+    char *output_file;
+    pid_t pid;               //-1 when it could not be started, 0 once reaped
+    struct rusage usage;     //from wait4 once reaped, zero before
+    struct timespec ended;   //when it was reaped, for time
+} stage_t;
+
+//bump allocator for the text of one line's tokens, emptied before the next line
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+} arena_t;
+
+//tokens of one line, in small until a line has more than MAX_TOKENS; the
+//strings themselves all live in text
+typedef struct {
+    char **items;
+    int capacity;
+    char *small[MAX_TOKENS];
+    arena_t text;
+} token_list_t;
+
+typedef struct job {
     int id;
     pid_t pgid; //process groups
-    char cmdline[BUFFER_SIZE+1]; //entire command line
+    char *cmdline; //entire command line
     int status;              //0 = running 1 = stopped 2 = done
+    pid_t *pids;             //one per stage, 0 once reaped
+    int stages;
+    int running;             //stages not reaped yet
+    int exit_code;           //of the last stage, once reaped
+    struct timeval cpu;      //user + system time of the stages reaped so far
+    struct job *prev, *next; //all jobs, oldest first
 } job_t;
 
+//hash from job id or pid to its job
+typedef struct job_link {
+  int key;
+  job_t *job;
+  struct job_link *next;
+} job_link_t;
+
+typedef struct {
+  job_link_t **buckets;
+  int size; //power of two, grows with count
+  int count;
+} job_index_t;
 
 //count jobs, and start jobs with id 1
-static job_t jobs[MAX_JOBS];
+static job_t *first_job = NULL, *last_job = NULL;
+static job_index_t jobs_by_id, jobs_by_pid;
 static int next_job_id = 1;
 static int job_count = 0;
 
-//keep track of the job history
-static char history[MAX_HISTORY][BUFFER_SIZE+1];
-static int history_length = 0;
+//keep track of the job history, a ring of the last history_capacity lines:
+//line n (counting from 1 over the whole session) is in history[n % history_capacity]
+static char **history = NULL;
+static int history_capacity = MAX_HISTORY;
+static long history_total = 0; //lines ever added
+static int history_fd = -1;    //history file, opened O_APPEND
+
+//for history -s: every 3 character substring of a line hashes to a bucket that
+//lists the numbers of the lines holding it, oldest first
+typedef struct {
+  long *lines;
+  int start, end, size; //live numbers are lines[start, end)
+} posting_t;
+
+static posting_t history_index[HISTORY_INDEX_BUCKETS];
+
+//command name -> path cache, like bash's hash table
+typedef struct hash_entry {
+  char *name;
+  char *path;
+  int hits;
+  struct hash_entry *next;
+} hash_entry_t;
+
+static hash_entry_t *command_hash[HASH_BUCKETS];
+static char *hashed_path = NULL; //PATH the cached paths were found with
 
 pid_t fg_pgid = 0; //process group in foreground
 
-//last commandline
-char last_cmd[BUFFER_SIZE+1] = {0};
+//the prompt waits on both stdin and a signalfd for SIGCHLD, so jobs are
+//reported as they finish rather than at the next enter
+static int epoll_fd = -1;
+static int sigchld_fd = -1;
+static int input_pollable = 0; //regular files can't be polled, they are always ready
+
+//set pipesize=N, the buffer size of pipeline pipes; 0 keeps the kernel's default
+static int pipe_size = 0;
+
+//stdin, or a script file, is read by the shell itself: stdio's buffer would hide input from epoll
+typedef struct {
+  int fd;
+  size_t block; //least free space to read into
+  char *data;
+  size_t size;
+  size_t start, end; //unread bytes are data[start, end)
+  int eof;
+} input_t;
+
+static input_t input = {STDIN_FILENO, INPUT_BLOCK, NULL, 0, 0, 0, 0};
+
+//prompt, history and the watchdog only when a user is typing at a terminal
+static int interactive = 1;
+
 
 
 //helpers
 
-static void trim(char *str)
+//drop every descriptor from fd up, with one close_range where glibc has it
+static void close_from(int fd)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 34)
+  close_range(fd, ~0U, 0);
+#else
+  for(long last = sysconf(_SC_OPEN_MAX); fd < last; fd ++)
+  {
+    close(fd);
+  }
+#endif
+}
+
+static unsigned int trigram_bucket(const char *p)
+{
+  unsigned int key = ((unsigned char)p[0] << 16) | ((unsigned char)p[1] << 8) | (unsigned char)p[2];
+  return (key * 2654435769u) >> 20; //top 12 bits, HISTORY_INDEX_BUCKETS
+}
+
+//index line number n, or (remove) drop it from the front of its buckets; lines
+//leave the ring in the order they entered, so n is always the oldest there
+static void index_history(const char *line, long n, int remove)
+{
+  for(const char *p = line; p[0] != '\0' && p[1] != '\0' && p[2] != '\0'; p ++)
+  {
+    posting_t *post = &history_index[trigram_bucket(p)];
+    if(remove)
+    {
+      if(post->start < post->end && post->lines[post->start] == n)
+      {
+        post->start ++;
+      }
+      continue;
+    }
+    if(post->start < post->end && post->lines[post->end - 1] == n)
+    {
+      continue; //repeated trigram
+    }
+    if(post->end == post->size)
+    {
+      //slide the live part down, or grow
+      if(post->start > post->size / 2)
+      {
+        memmove(post->lines, post->lines + post->start, sizeof(long) * (post->end - post->start));
+        post->end -= post->start;
+        post->start = 0;
+      }
+      else
+      {
+        post->size = post->size == 0 ? 8 : post->size * 2;
+        post->lines = realloc(post->lines, sizeof(long) * post->size);
+      }
+    }
+    post->lines[post->end ++] = n;
+  }
+}
+
+//put a line in the ring (and the index), replacing the oldest once it is full
+static void remember_history(const char *line)
 {
-  //trims a \n string to end with \0
-  size_t n = strlen(str);
-  if(n > 0 && str[n - 1] == '\n')
+  history_total ++;
+  char **slot = &history[history_total % history_capacity];
+  if(*slot != NULL)
   {
-    str[n - 1] = '\0';
+    index_history(*slot, history_total - history_capacity, 1);
+    free(*slot);
   }
+  *slot = strdup(line);
+  index_history(line, history_total, 0);
 }
 
 static void add_history(const char *line)
@@ -61,118 +224,340 @@ static void add_history(const char *line)
   {
     return; //null check
   }
-  if (history_length < MAX_HISTORY)
-  {
-    strncpy(history[history_length], line, BUFFER_SIZE);
-    history_length ++;
-  }
-  else
+  remember_history(line);
+
+  //one write per line on an O_APPEND descriptor, so lines of concurrent
+  //shells end up whole and in some order in the file
+  if(history_fd >= 0)
   {
-    //history at max, so delete first element and shift to left
-    for(size_t i = 1; i < MAX_HISTORY; i ++)
+    size_t length = strlen(line);
+    char *record = malloc(length + 1);
+    memcpy(record, line, length);
+    record[length] = '\n';
+    if(write(history_fd, record, length + 1) < 0)
     {
-      strncpy(history[i - 1], history[i], BUFFER_SIZE);
-      history[i - 1][BUFFER_SIZE] = '\0';
+      close(history_fd); //e.g. disk full, keep going without the file
+      history_fd = -1;
     }
-    strncpy(history[MAX_HISTORY - 1], line, BUFFER_SIZE);
+    free(record);
   }
 }
 
-static int find_slot()
+//set up the ring with HISTSIZE lines, and load the end of HISTFILE
+//(or ~/.mini_shell_history) into it
+static void init_history()
 {
-  for(int i = 0; i < MAX_JOBS; i ++)
+  const char *size = getenv("HISTSIZE");
+  if(size != NULL && atoi(size) > 0)
+  {
+    history_capacity = atoi(size);
+  }
+  history = calloc(history_capacity, sizeof(char *));
+
+  char file[PATH_MAX];
+  const char *path = getenv("HISTFILE");
+  if(path == NULL)
+  {
+    const char *home = getenv("HOME");
+    if(home == NULL)
+    {
+      return; //memory only
+    }
+    snprintf(file, sizeof(file), "%s/.mini_shell_history", home);
+    path = file;
+  }
+  history_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  if(history_fd < 0)
+  {
+    return;
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if(fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+  {
+    if(fd >= 0)
+    {
+      close(fd);
+    }
+    return;
+  }
+  char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+  {
+    return;
+  }
+
+  //only the last history_capacity lines matter, so walk back from the end of
+  //the file instead of reading all of it; a line still being written by
+  //another shell has no newline yet and is left out
+  char *end = data + st.st_size;
+  while(end > data && end[-1] != '\n')
+  {
+    end --;
+  }
+  char *start = end;
+  int lines = 0;
+  while(start > data && lines <= history_capacity)
   {
-    if(jobs[i].id == 0) //find next job id or if cannot, return -1
+    start --;
+    if(start == data || start[-1] == '\n')
+    {
+      lines ++;
+    }
+  }
+  if(lines > history_capacity)
+  {
+    start = memchr(start, '\n', end - start) + 1; //one too many
+  }
+
+  char *line = NULL;
+  size_t line_size = 0;
+  for(char *p = start; p < end;)
+  {
+    char *newline = memchr(p, '\n', end - p);
+    size_t length = newline - p;
+    if(length + 1 > line_size)
+    {
+      line_size = length + 1;
+      line = realloc(line, line_size);
+    }
+    memcpy(line, p, length);
+    line[length] = '\0';
+    if(length > 0)
     {
-      return i;
+      remember_history(line);
     }
+    p = newline + 1;
   }
-  return -1;
+  free(line);
+  munmap(data, st.st_size);
+}
+
+static unsigned int index_bucket(const job_index_t *index, int key)
+{
+  //fibonacci hashing, pids and ids are mostly sequential
+  return ((unsigned int)key * 2654435769u) & (unsigned int)(index->size - 1);
 }
 
-static job_t* find_pgid(pid_t pgid)
+static job_t* index_get(const job_index_t *index, int key)
 {
-  //find pgid in jobs
-  for(int i = 0; i < MAX_JOBS; i ++)
+  if(index->size == 0)
   {
-    if(jobs[i].id != 0 && jobs[i].pgid == pgid)
+    return NULL;
+  }
+  for(job_link_t *link = index->buckets[index_bucket(index, key)]; link != NULL; link = link->next)
+  {
+    if(link->key == key)
     {
-      return &jobs[i];
+      return link->job;
     }
   }
   return NULL;
 }
 
-static job_t* find_id(int id)
+static void index_put(job_index_t *index, int key, job_t *job)
 {
-  for(int i = 0; i < MAX_JOBS; i ++)
+  if(index->count >= index->size)
   {
-    if(jobs[i].id == id)
+    //double the buckets and rehash, keeping chains at about one entry
+    job_index_t bigger = {NULL, index->size == 0 ? 16 : index->size * 2, index->count};
+    bigger.buckets = calloc(bigger.size, sizeof(job_link_t *));
+    for(int i = 0; i < index->size; i ++)
     {
-      return &jobs[i];
+      while(index->buckets[i] != NULL)
+      {
+        job_link_t *link = index->buckets[i];
+        index->buckets[i] = link->next;
+        unsigned int b = index_bucket(&bigger, link->key);
+        link->next = bigger.buckets[b];
+        bigger.buckets[b] = link;
+      }
     }
+    free(index->buckets);
+    *index = bigger;
   }
-  return NULL;
+  job_link_t *link = malloc(sizeof(job_link_t));
+  unsigned int b = index_bucket(index, key);
+  link->key = key;
+  link->job = job;
+  link->next = index->buckets[b];
+  index->buckets[b] = link;
+  index->count ++;
 }
 
-static void add_job(pid_t pgid, const char *cmdline, int status)
+static void index_remove(job_index_t *index, int key)
 {
-  //initialize and add job
-  int i = find_slot();
-  if(i < 0)
+  if(index->size == 0)
   {
-    fprintf(stderr, "too many jobs\n");
     return;
   }
-  jobs[i].id = next_job_id;
-  next_job_id ++;
-  jobs[i].pgid = pgid;
-  strncpy(jobs[i].cmdline, cmdline, BUFFER_SIZE);
-  jobs[i].status = status;
-  job_count ++;
+  for(job_link_t **link = &index->buckets[index_bucket(index, key)]; *link != NULL; link = &(*link)->next)
+  {
+    if((*link)->key == key)
+    {
+      job_link_t *found = *link;
+      *link = found->next;
+      free(found);
+      index->count --;
+      return;
+    }
+  }
+}
+
+static job_t* find_id(int id)
+{
+  return index_get(&jobs_by_id, id);
+}
 
+static void add_cpu(struct timeval *total, const struct rusage *usage)
+{
+  timeradd(total, &usage->ru_utime, total);
+  timeradd(total, &usage->ru_stime, total);
 }
 
-static void remove_job(int i)
+//track the started stages of a pipeline (pids <= 0 were not started or already reaped)
+static job_t* add_job(pid_t pgid, const stage_t *stages, int count, const char *cmdline, int status)
 {
-  if(i < 0 || i >= MAX_JOBS)
+  //initialize and add job
+  job_t *job = calloc(1, sizeof(job_t));
+  job->id = next_job_id;
+  next_job_id ++;
+  job->pgid = pgid;
+  job->cmdline = strdup(cmdline);
+  job->status = status;
+  job->pids = malloc(sizeof(pid_t) * count);
+  job->stages = count;
+  for(int i = 0; i < count; i ++)
   {
-    fprintf(stderr, "invalid index to remove");
-    return;
+    add_cpu(&job->cpu, &stages[i].usage); //stages already reaped in the foreground
+    job->pids[i] = stages[i].pid > 0 ? stages[i].pid : 0;
+    if(job->pids[i] != 0)
+    {
+      index_put(&jobs_by_pid, job->pids[i], job);
+      job->running ++;
+    }
   }
-  jobs[i].id = 0;
-  jobs[i].pgid = 0;
-  jobs[i].status = 0;
-  jobs[i].cmdline[0] = '\0';
-  job_count --;
+
+  job->prev = last_job;
+  if(last_job != NULL)
+  {
+    last_job->next = job;
+  }
+  else
+  {
+    first_job = job;
+  }
+  last_job = job;
+  index_put(&jobs_by_id, job->id, job);
+  job_count ++;
+  return job;
 }
 
-static void remove_job_pgid(pid_t pgid)
+static void remove_job(job_t *job)
 {
-  for(int i = 0; i < MAX_JOBS; i ++)
+  for(int i = 0; i < job->stages; i ++)
   {
-    if(jobs[i].id != 0 && jobs[i].pgid == pgid)
+    if(job->pids[i] != 0)
     {
-      remove_job(i);
-      return;
+      index_remove(&jobs_by_pid, job->pids[i]);
     }
   }
+  index_remove(&jobs_by_id, job->id);
+  if(job->prev != NULL)
+  {
+    job->prev->next = job->next;
+  }
+  else
+  {
+    first_job = job->next;
+  }
+  if(job->next != NULL)
+  {
+    job->next->prev = job->prev;
+  }
+  else
+  {
+    last_job = job->prev;
+  }
+  free(job->pids);
+  free(job->cmdline);
+  free(job);
+  job_count --;
 }
 
-static void print_jobs()
+//record a wait4 result for one of the job's processes, 1 once all of them are gone
+static int job_update(job_t *job, pid_t pid, int status, const struct rusage *usage)
 {
-  for(int i = 0; i < MAX_JOBS; i ++)
+  if(WIFEXITED(status) || WIFSIGNALED(status))
   {
-    if(jobs[i].id == 0)
+    add_cpu(&job->cpu, usage);
+    for(int i = 0; i < job->stages; i ++)
+    {
+      if(job->pids[i] == pid)
+      {
+        if(i == job->stages - 1)
+        {
+          job->exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status) + 128; //128 signal convention
+        }
+        job->pids[i] = 0;
+        index_remove(&jobs_by_pid, pid);
+        job->running --;
+        break;
+      }
+    }
+    if(job->running == 0)
     {
-      continue; //only print jobs that exist
+      job->status = JOB_DONE;
+      return 1;
     }
+  }
+  else if(WIFSTOPPED(status))
+  {
+    job->status = JOB_STOPPED;
+  }
+  else if(WIFCONTINUED(status))
+  {
+    job->status = JOB_RUNNING;
+  }
+  return 0;
+}
+
+//user + system seconds used so far by a process that is still running
+static double process_cpu(pid_t pid)
+{
+  char path[64], buffer[1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+  {
+    return 0;
+  }
+  ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+  buffer[n > 0 ? n : 0] = '\0';
+  //the command name may hold spaces and parens, the fields start after the last )
+  char *fields = strrchr(buffer, ')');
+  unsigned long utime, stime;
+  if(fields == NULL || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+  {
+    return 0;
+  }
+  return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+//cpu adds each job's user + system time, its reaped stages plus the running ones
+static void print_jobs(int cpu)
+{
+  for(job_t *job = first_job; job != NULL; job = job->next)
+  {
     char *status;
-    if(jobs[i].status == JOB_RUNNING)
+    if(job->status == JOB_RUNNING)
     {
       status = "Running";
     }
-    else if(jobs[i].status == JOB_STOPPED)
+    else if(job->status == JOB_STOPPED)
     {
       status = "Stopped";
     }
@@ -180,70 +565,101 @@ static void print_jobs()
     {
       status = "Done";
     }
-    printf("%d. %d %s   %s\n", jobs[i].id, (int)jobs[i].pgid, status, jobs[i].cmdline);
+    if(cpu)
+    {
+      double seconds = job->cpu.tv_sec + job->cpu.tv_usec / 1e6;
+      for(int i = 0; i < job->stages; i ++)
+      {
+        if(job->pids[i] > 0)
+        {
+          seconds += process_cpu(job->pids[i]);
+        }
+      }
+      printf("%d. %d %s   %.2fs cpu   %s\n", job->id, (int)job->pgid, status, seconds, job->cmdline);
+    }
+    else
+    {
+      printf("%d. %d %s   %s\n", job->id, (int)job->pgid, status, job->cmdline);
+    }
+  }
+}
+
+//report a wait4 result for a background or stopped job, 1 if a notice was printed
+static int note_child(pid_t pid, int status, const struct rusage *usage)
+{
+  //by pid, the process is gone so getpgid would no longer find it
+  job_t *job = index_get(&jobs_by_pid, pid);
+  if(job == NULL)
+  {
+    //null check
+    return 0;
+  }
+
+  int was = job->status;
+  if(job_update(job, pid, status, usage))
+  {
+    //if every stage was killed or exited, then remove job and mark as done
+    printf("\n[%d]  Finished %s\n", job->id, job->cmdline);
+    remove_job(job);
   }
+  else if(job->status == JOB_STOPPED && was != JOB_STOPPED)
+  {
+    printf("\n[%d]  Stopped %s\n", job->id, job->cmdline);
+  }
+  else if(job->status == JOB_RUNNING && was != JOB_RUNNING)
+  {
+    printf("\n[%d]  Continued %s\n", job->id, job->cmdline);
+  }
+  else
+  {
+    return 0;
+  }
+  fflush(stdout); //may be in the middle of a foreground command
+  return 1;
 }
 
-//helper to prevent buildup of zombie processes after a fork statement
-static void reap()
+//helper to prevent buildup of zombie processes after a fork statement, returns
+//the number of notices printed
+static int reap()
 {
   int status;
   pid_t pid;
+  struct rusage usage;
+  int notices = 0;
   //keep checking for processes
   while(1)
   {
-    pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED);
+    pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage);
     if(pid <= 0)
     {
       //no more children
       break;
     }
+    notices += note_child(pid, status, &usage);
+  }
+  return notices;
+}
 
-    pid_t pgid = getpgid(pid);
-    if(pgid <= 0)
-    {
-      //if no pgid, continue
-      continue;
-    }
-    job_t *job = find_pgid(pgid);
-    if(job == NULL)
-    {
-      //null check
-      continue;
-    }
-
-    if(WIFEXITED(status) || WIFSIGNALED(status))
-    {
-      //if killed or exited, then remove job and mark as done
-      job->status = JOB_DONE;
-      printf("\n[%d]  Finished %s\n", job->id, job->cmdline);
-      remove_job_pgid(job->pgid);
-    } 
-    else if(WIFSTOPPED(status))
-    {
-      //if stopped then set job as stopped
-      job->status = JOB_STOPPED;
-      printf("\n[%d]  Stopped %s\n", job->id, job->cmdline);
-    } 
-    else if(WIFCONTINUED(status))
-    {
-      job->status = JOB_RUNNING;
-      printf("\n[%d]  Continued %s\n", job->id, job->cmdline);
-    }
+//SIGCHLD is blocked and read from sigchld_fd, only reap once one came in
+static int sigchld_pending()
+{
+  struct signalfd_siginfo info;
+  int pending = 0;
+  while(read(sigchld_fd, &info, sizeof(info)) == sizeof(info))
+  {
+    pending = 1; //several exits may share one signal, reap() gets them all
   }
+  return pending;
 }
 
 static void kill_all()
 {
-  for(int i = 0; i < MAX_JOBS; i ++)
+  for(job_t *job = first_job; job != NULL; job = job->next)
   {
-    if(jobs[i].id != 0)
+    if(job->pgid > 0)
     {
-      if(jobs[i].pgid > 0)
-      {
-        //kill with - sign means to kill the entire pg
-        kill(-jobs[i].pgid, SIGTERM);
-      }
+      //kill with - sign means to kill the entire pg
+      kill(-job->pgid, SIGTERM);
     }
   }
 }
@@ -276,13 +692,71 @@ static void sigtstp_handler(int signal)
   }
 }
 
-//tokenization based on parse.c, which caller will free tokens array and tokens in it
-static int tokenize(const char *line, char *tokens[], int max_tokens)
+//tokenization based on parse.c: the token strings are slices of the list's per-line
+//arena, never freed one by one, and are dropped together when arena_reset starts the next line
+
+//make room for one more token (and the NULL after the last one)
+static void grow_tokens(token_list_t *list, int n)
+{
+  if(n + 1 < list->capacity)
+  {
+    return;
+  }
+  list->capacity *= 2;
+  if(list->items == list->small)
+  {
+    list->items = malloc(sizeof(char *) * list->capacity);
+    memcpy(list->items, list->small, sizeof(list->small));
+  }
+  else
+  {
+    list->items = realloc(list->items, sizeof(char *) * list->capacity);
+  }
+}
+
+//take n bytes from the arena, which tokenize sized for the whole line up front
+static char* arena_alloc(arena_t *arena, size_t n)
+{
+  char *p = arena->base + arena->used;
+  arena->used += n;
+  return p;
+}
+
+//make sure n bytes fit without moving, the old contents are dropped
+static void arena_reset(arena_t *arena, size_t n)
+{
+  if(n > arena->size)
+  {
+    free(arena->base);
+    arena->size = n > 2 * arena->size ? n : 2 * arena->size;
+    arena->base = malloc(arena->size);
+  }
+  arena->used = 0;
+}
+
+//operator token of length chars starting at p
+static char* arena_operator(arena_t *arena, const char *p, size_t length)
+{
+  char *op = arena_alloc(arena, length + 1);
+  memcpy(op, p, length);
+  op[length] = '\0';
+  return op;
+}
+
+//split a line into tokens, words are cut out of a copy of the line in place and
+//operators get their own few bytes, so a line costs no allocation per token;
+//the tokens stay valid until the next call
+static int tokenize(const char *line, token_list_t *list)
 {
   int n = 0;
-  const char *p = line; //pointer for parsing
-  while(*p != '\0' && n < max_tokens)
+  size_t length = strlen(line);
+  //the copy of the line, plus at worst 2 bytes per operator char ("a;b;c")
+  arena_reset(&list->text, 3 * length + 1);
+  char *p = memcpy(arena_alloc(&list->text, length + 1), line, length + 1); //pointer for parsing
+  while(*p != '\0')
   {
+    grow_tokens(list, n);
+    char **tokens = list->items;
     //skip whitespace
     if(isspace((unsigned char) *p))
     {
@@ -290,16 +764,9 @@ static int tokenize(const char *line, char *tokens[], int max_tokens)
       continue;
     }
     //multi char operators
-    if(p[0] == '&' && p[1] == '&')
-    {
-      tokens[n] = strdup("&&"); //creats heap allocated string, as tokens[] holds heap allocated strings
-      n ++;
-      p += 2;
-      continue;
-    }
-    if(p[0] == '|' && p[1] == '|')
+    if((p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|'))
     {
-      tokens[n] = strdup("||"); //creats heap allocated string, as tokens[] holds heap allocated strings
+      tokens[n] = arena_operator(&list->text, p, 2);
       n ++;
       p += 2;
       continue;
@@ -307,49 +774,183 @@ static int tokenize(const char *line, char *tokens[], int max_tokens)
     //signle char operators
     if(*p == '&' || *p == '|' || *p == ';' || *p == '<' || *p == '>')
     {
-      char temp[2] = {*p, '\0'}; //create a temp string that take sthe rest of p and appends '\0' to it
-      tokens[n] = strdup(temp);
+      tokens[n] = arena_operator(&list->text, p, 1);
       n ++;
       p ++;
       continue;
     }
-    const char *start = p;
+    tokens[n] = p;
+    n ++;
     while(*p != '\0' && !isspace((unsigned char) *p))
     {
-      if((p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|') || *p == '&' || *p == '|' || *p == ';' || *p == '<' || *p == '>')
+      if(*p == '&' || *p == '|' || *p == ';' || *p == '<' || *p == '>')
       {
         //break when we get to a space or operator
         break;
       }
       p ++;
     }
-    size_t length = p - start;
-    char *token = (char *)malloc(sizeof(char) * (length + 1));
-    strncpy(token, start, length);
-    token[length] = '\0';
-    tokens[n] = token;
-    n ++;
+    if(isspace((unsigned char) *p))
+    {
+      //terminate the word over the space after it
+      *p = '\0';
+      p ++;
+    }
+    else if(*p != '\0')
+    {
+      //the operator is read before its first char is overwritten
+      char *end = p;
+      if((p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|'))
+      {
+        tokens[n] = arena_operator(&list->text, p, 2);
+        p += 2;
+      }
+      else
+      {
+        tokens[n] = arena_operator(&list->text, p, 1);
+        p ++;
+      }
+      n ++; //grow_tokens left room for the word and this one
+      *end = '\0';
+    }
   }
-  tokens[n] = NULL;
+  grow_tokens(list, n);
+  list->items[n] = NULL;
   return n;
 }
-static void free_tokens(char *tokens[], int n)
+//resolve a command name to an executable path like execvp would, 0 if there is none
+static int find_command(const char *name, char *path, size_t size)
 {
-  //free tokens in tokens[] but not the array itself
-  for(int i = 0; i < n; i ++)
+  struct stat st;
+  if(strchr(name, '/') != NULL)
   {
-    free(tokens[i]);
-    tokens[i] = NULL;
+    //paths are used as given
+    snprintf(path, size, "%s", name);
+    return 1;
   }
-}
-static int cd (char **argv)
-{
-  if(argv[1] == NULL || argv[1][0] == '\0') //if just call cd alone, which brings to home directory
+  const char *dirs = getenv("PATH");
+  if(dirs == NULL)
   {
-    const char *home = getenv("HOME"); //find home
-    if(home == NULL)
-    {
-      home = "/"; //string bc comparing to "home"
+    dirs = "/bin:/usr/bin";
+  }
+  while(1)
+  {
+    const char *end = strchr(dirs, ':');
+    size_t length = end != NULL ? (size_t)(end - dirs) : strlen(dirs);
+    //empty entry means the current directory
+    int n = length == 0 ? snprintf(path, size, "%s", name) : snprintf(path, size, "%.*s/%s", (int)length, dirs, name);
+    if(n > 0 && (size_t)n < size && stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0)
+    {
+      return 1;
+    }
+    if(end == NULL)
+    {
+      return 0;
+    }
+    dirs = end + 1;
+  }
+}
+
+//command hash, so PATH is only searched the first time a name is run
+
+static unsigned int hash_name(const char *name)
+{
+  //fnv-1a
+  unsigned int h = 2166136261u;
+  for(const char *p = name; *p != '\0'; p ++)
+  {
+    h = (h ^ (unsigned char)*p) * 16777619u;
+  }
+  return h % HASH_BUCKETS;
+}
+
+static void hash_clear()
+{
+  for(int i = 0; i < HASH_BUCKETS; i ++)
+  {
+    while(command_hash[i] != NULL)
+    {
+      hash_entry_t *entry = command_hash[i];
+      command_hash[i] = entry->next;
+      free(entry->name);
+      free(entry->path);
+      free(entry);
+    }
+  }
+}
+
+static hash_entry_t** hash_find(const char *name)
+{
+  //returns the link pointing at the entry, so it can also be unlinked
+  hash_entry_t **link = &command_hash[hash_name(name)];
+  while(*link != NULL && strcmp((*link)->name, name) != 0)
+  {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+static void hash_remove(const char *name)
+{
+  hash_entry_t **link = hash_find(name);
+  hash_entry_t *entry = *link;
+  if(entry != NULL)
+  {
+    *link = entry->next;
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+  }
+}
+
+//find_command through the cache; hit counts how many runs the entry served
+static int resolve_command(const char *name, char *path, size_t size, int hit)
+{
+  if(strchr(name, '/') != NULL)
+  {
+    return find_command(name, path, size); //paths are never cached
+  }
+
+  //a changed PATH may resolve every name differently
+  const char *dirs = getenv("PATH");
+  if(dirs == NULL)
+  {
+    dirs = "";
+  }
+  if(hashed_path == NULL || strcmp(hashed_path, dirs) != 0)
+  {
+    hash_clear();
+    free(hashed_path);
+    hashed_path = strdup(dirs);
+  }
+
+  hash_entry_t **link = hash_find(name);
+  if(*link == NULL)
+  {
+    if(!find_command(name, path, size))
+    {
+      return 0;
+    }
+    hash_entry_t *entry = malloc(sizeof(hash_entry_t));
+    entry->name = strdup(name);
+    entry->path = strdup(path);
+    entry->hits = 0;
+    entry->next = NULL;
+    *link = entry;
+  }
+  (*link)->hits += hit;
+  snprintf(path, size, "%s", (*link)->path);
+  return 1;
+}
+
+static int cd (char **argv)
+{
+  if(argv[1] == NULL || argv[1][0] == '\0') //if just call cd alone, which brings to home directory
+  {
+    const char *home = getenv("HOME"); //find home
+    if(home == NULL)
+    {
+      home = "/"; //string bc comparing to "home"
     }
     if(chdir(home) < 0)
     {
@@ -381,9 +982,15 @@ static void help()
   printf("exit            - terminates the most recently run shell\n");
   printf("help            - explains how to use this mini-shell's built in functions\n");
   printf("fg <jobid>      - moves a background job to the foreground\n");
-  printf("jobs            - lists the job processes that are running or suspended\n");
+  printf("jobs [-t]       - lists the job processes that are running or suspended, -t with cpu time\n");
   printf("bg <jobid>      - resumes a job in the background\n");
-  printf("history         - shows command history\n");
+  printf("history [-s pat]- shows command history, or the lines containing pat\n");
+  printf("hash [-r] [name]- shows the cached command paths, -r forgets them\n");
+  printf("time <command>  - runs command, then shows the time and usage of each stage\n");
+  printf("set [pipesize=n]- shows or sets options, pipesize is the pipe buffer in bytes (k, m)\n");
+  printf("parallel [-j n] [-e] [-f file] [cmd {} ::: args]\n");
+  printf("                - runs the lines of file or stdin, or cmd once per arg with {}\n");
+  printf("                  replaced by it, n at a time; -e starts no more after a failure\n");
 }
 
 static int fg(char **argv)
@@ -406,29 +1013,30 @@ static int fg(char **argv)
 
   int status;
   pid_t pid;
+  struct rusage usage;
   int exit_code = 0;
-  while((pid = waitpid(-job->pgid, &status, WUNTRACED)) > 0) //check if its stopped or signaled
+  //wait for any child, so background jobs are still reported meanwhile
+  while((pid = wait4(-1, &status, WUNTRACED | WCONTINUED, &usage)) > 0) //check if its stopped or signaled
   {
+    if(index_get(&jobs_by_pid, pid) != job)
+    {
+      note_child(pid, status, &usage);
+      continue;
+    }
+    if(job_update(job, pid, status, &usage))
+    {
+      //every stage exited or was killed
+      exit_code = job->exit_code;
+      remove_job(job);
+      break;
+    }
     if(WIFSTOPPED(status))
     {
-      job->status = JOB_STOPPED;
       printf("\n[%d]  Stopped %s\n", job->id, job->cmdline);
       fg_pgid = 0;
       exit_code = 0;
       break;
     } 
-    else if(WIFEXITED(status))
-    {
-      exit_code = WEXITSTATUS(status);
-      remove_job_pgid(job->pgid);
-      break;
-    }
-    else if(WIFSIGNALED(status))
-    {
-      exit_code = WTERMSIG(status) + 128; //128 signal convention
-      remove_job_pgid(job->pgid);
-      break;
-    }
   }
   fg_pgid = 0;
   return exit_code; 
@@ -436,7 +1044,12 @@ static int fg(char **argv)
 
 static int jobs_cmd(char **argv)
 {
-  print_jobs();
+  if(argv[1] != NULL && strcmp(argv[1], "-t") != 0)
+  {
+    fprintf(stderr, "usage: jobs [-t]\n");
+    return 1;
+  }
+  print_jobs(argv[1] != NULL);
   return 0;
 }
 
@@ -460,16 +1073,173 @@ static int bg(char **argv)
   return 0;
 }
 
-//custom function (history)
+//custom function (history), history -s pattern lists only lines containing pattern
 static int history_cmd(char **argv)
 {
-  for(int i = 0; i < history_length; i ++)
+  long first = history_total - history_capacity + 1; //oldest line still in the ring
+  if(first < 1)
   {
-    printf("%d  %s\n", i + 1, history[i]);
+    first = 1;
+  }
+  if(argv[1] == NULL)
+  {
+    for(long n = first; n <= history_total; n ++)
+    {
+      printf("%ld  %s\n", n, history[n % history_capacity]);
+    }
+    return 0;
+  }
+  if(strcmp(argv[1], "-s") != 0 || argv[2] == NULL)
+  {
+    fprintf(stderr, "usage: history [-s pattern]\n");
+    return 1;
+  }
+
+  const char *pattern = argv[2];
+  if(strlen(pattern) < 3)
+  {
+    //too short for the index
+    for(long n = first; n <= history_total; n ++)
+    {
+      if(strstr(history[n % history_capacity], pattern) != NULL)
+      {
+        printf("%ld  %s\n", n, history[n % history_capacity]);
+      }
+    }
+    return 0;
+  }
+
+  //every match holds all of the pattern's trigrams, so the shortest of their
+  //lists has all matches (and some lines that only share a bucket)
+  posting_t *best = NULL;
+  for(const char *p = pattern; p[2] != '\0'; p ++)
+  {
+    posting_t *post = &history_index[trigram_bucket(p)];
+    if(best == NULL || post->end - post->start < best->end - best->start)
+    {
+      best = post;
+    }
+  }
+  for(int i = best->start; i < best->end; i ++)
+  {
+    long n = best->lines[i];
+    if(strstr(history[n % history_capacity], pattern) != NULL)
+    {
+      printf("%ld  %s\n", n, history[n % history_capacity]);
+    }
+  }
+  return 0;
+}
+
+static int hash_cmd(char **argv)
+{
+  if(argv[1] != NULL && strcmp(argv[1], "-r") == 0)
+  {
+    hash_clear();
+    return 0;
+  }
+  if(argv[1] != NULL)
+  {
+    //look names up now, without running them
+    int status = 0;
+    char path[PATH_MAX];
+    for(int i = 1; argv[i] != NULL; i ++)
+    {
+      if(!resolve_command(argv[i], path, sizeof(path), 0))
+      {
+        fprintf(stderr, "hash: %s: not found\n", argv[i]);
+        status = 1;
+      }
+    }
+    return status;
+  }
+
+  int empty = 1;
+  for(int i = 0; i < HASH_BUCKETS; i ++)
+  {
+    for(hash_entry_t *entry = command_hash[i]; entry != NULL; entry = entry->next)
+    {
+      if(empty)
+      {
+        printf("hits    command\n");
+        empty = 0;
+      }
+      printf("%4d    %s\n", entry->hits, entry->path);
+    }
+  }
+  if(empty)
+  {
+    printf("hash: hash table empty\n");
   }
   return 0;
 }
 
+//set pipesize=N[k|m] sizes the pipes of later pipelines, set alone lists the options
+static int set_cmd(char **argv)
+{
+  if(argv[1] == NULL)
+  {
+    printf("pipesize=%d\n", pipe_size);
+    return 0;
+  }
+  int status = 0;
+  for(int i = 1; argv[i] != NULL; i ++)
+  {
+    if(strncmp(argv[i], "pipesize=", 9) != 0)
+    {
+      fprintf(stderr, "set: unknown option %s\n", argv[i]);
+      status = 1;
+      continue;
+    }
+    char *end;
+    long size = strtol(argv[i] + 9, &end, 10);
+    if(*end == 'k' || *end == 'K')
+    {
+      size <<= 10;
+      end ++;
+    }
+    else if(*end == 'm' || *end == 'M')
+    {
+      size <<= 20;
+      end ++;
+    }
+    if(end == argv[i] + 9 || *end != '\0' || size < 0 || size > INT_MAX)
+    {
+      fprintf(stderr, "set: bad pipe size %s\n", argv[i] + 9);
+      status = 1;
+      continue;
+    }
+    if(size == 0)
+    {
+      pipe_size = 0;
+      continue;
+    }
+    //try it on a pipe now, the kernel rounds it up and caps it for unprivileged users
+    int fds[2];
+    if(pipe(fds) < 0)
+    {
+      fprintf(stderr, "set: pipe: %s\n", strerror(errno));
+      status = 1;
+      continue;
+    }
+    int granted = fcntl(fds[1], F_SETPIPE_SZ, (int)size);
+    if(granted < 0)
+    {
+      fprintf(stderr, "set: pipesize=%ld: %s\n", size, strerror(errno));
+      status = 1;
+    }
+    else
+    {
+      pipe_size = granted;
+    }
+    close(fds[0]);
+    close(fds[1]);
+  }
+  return status;
+}
+
+static int parallel_cmd(char **argv); //runs commands, so it comes after execute
+
 static int cmd_handler(char **argv, int *return_status)
 {
   //handles built in commands and returns 1 if found command
@@ -484,69 +1254,627 @@ static int cmd_handler(char **argv, int *return_status)
   }
   if(strcmp(argv[0], "exit") == 0)
   {
-    *return_status = exit_terminal(argv);
-    //no need to return as exited
+    *return_status = exit_terminal(argv);
+    //no need to return as exited
+  }
+  if(strcmp(argv[0], "help") == 0)
+  {
+    help();
+    *return_status = 0;
+    return 1;
+  }
+  if(strcmp(argv[0], "fg") == 0)
+  {
+    *return_status = fg(argv);
+    return 1;
+  }
+  if(strcmp(argv[0], "jobs") == 0)
+  {
+    *return_status = jobs_cmd(argv);
+    return 1;
+  }
+  if(strcmp(argv[0], "bg") == 0)
+  {
+    *return_status = bg(argv);
+    return 1;
+  }
+  if(strcmp(argv[0], "history") == 0)
+  {
+    *return_status = history_cmd(argv);
+    return 1;
+  }
+  if(strcmp(argv[0], "hash") == 0)
+  {
+    *return_status = hash_cmd(argv);
+    return 1;
+  }
+  if(strcmp(argv[0], "set") == 0)
+  {
+    *return_status = set_cmd(argv);
+    return 1;
+  }
+  if(strcmp(argv[0], "parallel") == 0)
+  {
+    *return_status = parallel_cmd(argv);
+    return 1;
+  }
+  return 0;
+}
+//set up the prompt's event loop: SIGCHLD through a signalfd, and stdin
+static void init_events()
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &signals, NULL); //spawned children get an empty mask
+  sigchld_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  struct epoll_event event = {0};
+  event.events = EPOLLIN;
+  event.data.fd = sigchld_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sigchld_fd, &event);
+  event.data.fd = input.fd;
+  input_pollable = !input.eof && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, input.fd, &event) == 0;
+}
+
+//block until the input is readable, reporting jobs that change state in the meantime
+static void wait_input()
+{
+  if(!input_pollable)
+  {
+    //a file never blocks, just catch up on the jobs
+    if(sigchld_pending())
+    {
+      reap();
+    }
+    return;
+  }
+  struct epoll_event events[2];
+  while(1)
+  {
+    int ready = epoll_wait(epoll_fd, events, 2, -1);
+    if(ready < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue; //ctrl z with nothing in the foreground
+      }
+      return;
+    }
+    int readable = 0;
+    for(int i = 0; i < ready; i ++)
+    {
+      if(events[i].data.fd == sigchld_fd)
+      {
+        if(sigchld_pending() && reap() > 0 && interactive)
+        {
+          //the notices went over the prompt, show it again
+          printf("mini-shell>");
+          fflush(stdout);
+        }
+      }
+      else
+      {
+        readable = 1; //also on hangup, read() then sees the end
+      }
+    }
+    if(readable)
+    {
+      return;
+    }
+  }
+}
+
+//reads commands of any length, the line stays valid until the next call; NULL at the end of input
+static char* read_cmd()
+{
+  while(1)
+  {
+    char *newline = input.end > input.start ? memchr(input.data + input.start, '\n', input.end - input.start) : NULL;
+    if(newline != NULL)
+    {
+      char *line = input.data + input.start;
+      *newline = '\0';
+      input.start = newline - input.data + 1;
+      return line;
+    }
+    if(input.eof)
+    {
+      if(input.start == input.end)
+      {
+        return NULL;
+      }
+      //last line without a newline, there is always a spare byte after end
+      char *line = input.data + input.start;
+      input.data[input.end] = '\0';
+      input.start = input.end;
+      return line;
+    }
+
+    //move the partial line to the front, and make room for at least a block
+    memmove(input.data, input.data + input.start, input.end - input.start);
+    input.end -= input.start;
+    input.start = 0;
+    if(input.size - input.end < input.block + 1)
+    {
+      input.size = input.size == 0 ? 4 * input.block : 2 * input.size;
+      input.data = realloc(input.data, input.size);
+    }
+
+    wait_input();
+    ssize_t got = read(input.fd, input.data + input.end, input.size - input.end - 1);
+    if(got < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if(got <= 0)
+    {
+      input.eof = 1;
+    }
+    else
+    {
+      input.end += got;
+    }
+  }
+}
+
+//start one stage of a pipeline without forking the shell: posix_spawn does the
+//pgid, signal resets, pipe dup2s and redirections in the new process right before
+//the exec. in and out are its pipe ends, -1 for none. returns the pid, or -1 after
+//printing why it failed
+static pid_t spawn_stage(char **argv, int in, int out, const char *input_file,
+                         const char *output_file, pid_t pgid)
+{
+  if(argv[0] == NULL)
+  {
+    fprintf(stderr, "empty command\n");
+    return -1;
+  }
+  char path[PATH_MAX];
+  if(!resolve_command(argv[0], path, sizeof(path), 1))
+  {
+    fprintf(stderr, "%s: command not found--Did you mean something else?\n", argv[0]);
+    return -1;
+  }
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  //first one creates pgid (0), the rest join it
+  posix_spawnattr_setpgroup(&attr, pgid);
+  //default signals and an empty mask, whatever the shell itself uses
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTSTP);
+  sigaddset(&signals, SIGQUIT);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+  //redirections are opened here rather than as spawn file actions, so a missing
+  //file is reported by name and never mistaken for a missing command
+  int input_fd = -1, output_fd = -1;
+  if(input_file != NULL && (input_fd = open(input_file, O_RDONLY | O_CLOEXEC)) < 0) //open input file as read only
+  {
+    fprintf(stderr, "%s: %s\n", input_file, strerror(errno));
+    return -1;
+  }
+  if(output_file != NULL && (output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0)
+  {
+    fprintf(stderr, "%s: %s\n", output_file, strerror(errno));
+    if(input_fd >= 0)
+    {
+      close(input_fd);
+    }
+    return -1;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if(in >= 0)
+  {
+    posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO); //input from pipe
+  }
+  if(out >= 0)
+  {
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+  }
+  if(input_fd >= 0)
+  {
+    posix_spawn_file_actions_adddup2(&actions, input_fd, STDIN_FILENO); //a file wins over the pipe
+  }
+  if(output_fd >= 0)
+  {
+    posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO);
+  }
+  //the shell's own descriptors are all close-on-exec, this also drops any it
+  //inherited, in one close_range instead of a close per pipe
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 34)
+  posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+
+  pid_t pid;
+  int error = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+  if((error == ENOENT || error == EACCES) && strchr(argv[0], '/') == NULL && access(path, X_OK) != 0)
+  {
+    //the cached path was removed or made unrunnable since, search PATH again
+    hash_remove(argv[0]);
+    if(resolve_command(argv[0], path, sizeof(path), 1))
+    {
+      error = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+    }
+    else
+    {
+      fprintf(stderr, "%s: command not found--Did you mean something else?\n", argv[0]);
+      error = -1;
+    }
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if(input_fd >= 0)
+  {
+    close(input_fd);
+  }
+  if(output_fd >= 0)
+  {
+    close(output_fd);
+  }
+  if(error > 0)
+  {
+    //the exec itself failed
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(error));
+  }
+  return error == 0 ? pid : -1;
+}
+
+//copy fd 0 to fd 1 inside the kernel, 0 on success
+static int splice_all()
+{
+  ssize_t moved;
+  while((moved = splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)) != 0)
+  {
+    if(moved < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      if(errno != EINVAL)
+      {
+        return 1;
+      }
+      //an end splice can't handle (a file with O_APPEND, a tty), copy the rest
+      char buffer[SCRIPT_BLOCK];
+      ssize_t got;
+      while((got = read(STDIN_FILENO, buffer, sizeof(buffer))) != 0)
+      {
+        if(got < 0)
+        {
+          if(errno == EINTR)
+          {
+            continue;
+          }
+          return 1;
+        }
+        for(ssize_t done = 0; done < got; )
+        {
+          ssize_t put = write(STDOUT_FILENO, buffer + done, got - done);
+          if(put < 0 && errno != EINTR)
+          {
+            return 1;
+          }
+          done += put > 0 ? put : 0;
+        }
+      }
+      return 0;
+    }
+  }
+  return 0;
+}
+
+//a plain 'cat' [file] that only moves data from a file into the pipeline or from the
+//pipeline into a file, which the shell does itself with splice; the source file
+//through *source, NULL when it reads the pipe
+static int is_splice_cat(const stage_t *stage, int i, int count, const char **source)
+{
+  char **argv = stage->argv;
+  if(argv[0] == NULL || strcmp(argv[0], "cat") != 0 || count == 1)
+  {
+    return 0;
+  }
+  if(argv[1] != NULL && (argv[2] != NULL || argv[1][0] == '-'))
+  {
+    return 0; //options, or more than one file
+  }
+  *source = argv[1] != NULL ? argv[1] : stage->input_file;
+  if(*source != NULL)
+  {
+    return i == 0 && stage->output_file == NULL; //< file |
+  }
+  return i == count - 1 && stage->output_file != NULL; //| > file
+}
+
+//the cat stage runs in a forked shell rather than exec'ing cat, set up like
+//spawn_stage sets up a command; returns the pid, or -1
+static pid_t spawn_splice_cat(const stage_t *stage, const char *source, int in, int out, pid_t pgid)
+{
+  pid_t pid = fork();
+  if(pid < 0)
+  {
+    fprintf(stderr, "cat: %s\n", strerror(errno));
+    return -1;
+  }
+  if(pid == 0)
+  {
+    setpgid(0, pgid);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigprocmask(SIG_SETMASK, &signals, NULL);
+    if(in >= 0)
+    {
+      dup2(in, STDIN_FILENO);
+    }
+    if(out >= 0)
+    {
+      dup2(out, STDOUT_FILENO);
+    }
+    close_from(STDERR_FILENO + 1);
+
+    const char *name = source != NULL ? source : stage->output_file;
+    int fd = source != NULL ? open(source, O_RDONLY) : open(stage->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0 || dup2(fd, source != NULL ? STDIN_FILENO : STDOUT_FILENO) < 0)
+    {
+      fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+      _exit(1);
+    }
+    close(fd);
+    _exit(splice_all());
+  }
+  setpgid(pid, pgid == 0 ? pid : pgid); //also here, whichever of the two runs first
+  return pid;
+}
+
+static double seconds_between(const struct timespec *from, const struct timespec *to)
+{
+  return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+//one line of the time report, on stderr like the shell's other diagnostics
+static void print_usage(const char *label, double real, const struct rusage *usage)
+{
+  fprintf(stderr, "time: %-16s real %.3fs  user %.3fs  sys %.3fs  maxrss %ldk  csw %ld/%ld\n", label, real,
+          usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6, usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6,
+          usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+//time prefix: every stage that ran, then the pipeline as a whole (cpu and
+//switches added up, the largest rss, until the last stage was reaped)
+static void print_times(const stage_t *stages, int count, const struct timespec *started)
+{
+  struct rusage total = {0};
+  double real = 0;
+  for(int i = 0; i < count; i ++)
+  {
+    if(stages[i].pid != 0)
+    {
+      continue; //never started (-1)
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "[%d] %s", i + 1, stages[i].argv[0]);
+    double stage_real = seconds_between(started, &stages[i].ended);
+    print_usage(label, stage_real, &stages[i].usage);
+
+    timeradd(&total.ru_utime, &stages[i].usage.ru_utime, &total.ru_utime);
+    timeradd(&total.ru_stime, &stages[i].usage.ru_stime, &total.ru_stime);
+    total.ru_maxrss = stages[i].usage.ru_maxrss > total.ru_maxrss ? stages[i].usage.ru_maxrss : total.ru_maxrss;
+    total.ru_nvcsw += stages[i].usage.ru_nvcsw;
+    total.ru_nivcsw += stages[i].usage.ru_nivcsw;
+    real = stage_real > real ? stage_real : real;
   }
-  if(strcmp(argv[0], "help") == 0)
+  print_usage("total", real, &total);
+}
+
+//time on a builtin: what the shell itself used while running it
+static void print_builtin_time(const struct timespec *started, const struct rusage *before)
+{
+  struct timespec now;
+  struct rusage after;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  getrusage(RUSAGE_SELF, &after);
+  timersub(&after.ru_utime, &before->ru_utime, &after.ru_utime);
+  timersub(&after.ru_stime, &before->ru_stime, &after.ru_stime);
+  after.ru_nvcsw -= before->ru_nvcsw;
+  after.ru_nivcsw -= before->ru_nivcsw;
+  print_usage("total", seconds_between(started, &now), &after);
+}
+
+//start the stages of a pipeline, with the builtins and job tracking around it;
+//flag is 0 in the foreground, 1 for a & job and 2 for one that parallel reports on.
+//timed reports each stage's usage once a foreground pipeline is done
+static int run_pipeline(stage_t *stages, int count, int flag, int timed, char *last_cmdline)
+{
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  //builtin commands
+  if(count == 1 && flag == 0)
   {
-    help();
-    *return_status = 0;
-    return 1;
+    int return_status;
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    if(cmd_handler(stages[0].argv, &return_status))
+    {
+      if(timed)
+      {
+        print_builtin_time(&started, &before);
+      }
+      return return_status;
+    }
   }
-  if(strcmp(argv[0], "fg") == 0)
+  pid_t pgid = 0;
+  int spawned = 0;
+
+  //builtin output still in the buffer goes before the children's
+  fflush(stdout);
+
+  //launch commands, each pipe is made right before the stage writing to it, so
+  //the shell never holds more than two pipe ends however long the pipeline is
+  int in = -1; //read end of the pipe from the previous stage
+  for(int i = 0; i < count; i++)
   {
-    *return_status = fg(argv);
-    return 1;
+    int pipe_fds[2] = {-1, -1};
+    if(i < count - 1 && pipe2(pipe_fds, O_CLOEXEC) < 0)
+    {
+      fprintf(stderr, "pipe error: %s\n", strerror(errno));
+      for(int j = i; j < count; j ++)
+      {
+        stages[j].pid = -1; //never started
+      }
+      break;
+    }
+    if(pipe_size > 0 && pipe_fds[1] >= 0)
+    {
+      fcntl(pipe_fds[1], F_SETPIPE_SZ, pipe_size); //checked by set, the pipe keeps working without it
+    }
+    const char *source;
+    if(is_splice_cat(&stages[i], i, count, &source))
+    {
+      stages[i].pid = spawn_splice_cat(&stages[i], source, in, pipe_fds[1], pgid);
+    }
+    else
+    {
+      stages[i].pid = spawn_stage(stages[i].argv, in, pipe_fds[1], stages[i].input_file, stages[i].output_file, pgid);
+    }
+    if(stages[i].pid > 0)
+    {
+      if(pgid == 0)
+      {
+        pgid = stages[i].pid; //first one started leads the pgid
+      }
+      spawned ++;
+    }
+    if(in >= 0)
+    {
+      close(in);
+    }
+    if(pipe_fds[1] >= 0)
+    {
+      close(pipe_fds[1]);
+    }
+    in = pipe_fds[0];
   }
-  if(strcmp(argv[0], "jobs") == 0)
+  if(in >= 0)
   {
-    *return_status = jobs_cmd(argv);
-    return 1;
+    close(in);
   }
-  if(strcmp(argv[0], "bg") == 0)
+  if(spawned == 0)
   {
-    *return_status = bg(argv);
-    return 1;
+    return 127; //nothing could be started
   }
-  if(strcmp(argv[0], "history") == 0)
+  if(flag != 0) //background job
   {
-    *return_status = history_cmd(argv);
-    return 1;
+    job_t *job = add_job(pgid, stages, count, last_cmdline, JOB_RUNNING);
+    if(flag == 1)
+    {
+      printf("[%d] %d running in background\n", job->id, (int)pgid);
+    }
   }
-  return 0;
-}
-//reads commands
-static int read_cmd(char *dest, int n)
-{
-  if(fgets(dest, n, stdin) == NULL)
+  else //foreground job
   {
-    return 0;//null check
+    //exit status of the pipeline is that of its last stage
+    int exit_code = stages[count - 1].pid > 0 ? 0 : 127;
+    fg_pgid = pgid;
+    int status;
+    pid_t wpid;
+    struct rusage usage;
+    while(spawned > 0 && (wpid = wait4(-1, &status, WUNTRACED | WCONTINUED, &usage)) > 0)
+    {
+      int stage = -1;
+      for(int i = 0; i < count; i ++)
+      {
+        if(stages[i].pid == wpid)
+        {
+          stage = i;
+          break;
+        }
+      }
+      if(stage < 0)
+      {
+        //a background job, waiting on any child keeps its notices on time
+        note_child(wpid, status, &usage);
+        continue;
+      }
+      if(WIFSTOPPED(status))
+      {
+        job_t *job = add_job(pgid, stages, count, last_cmdline, JOB_STOPPED);
+        printf("\n[%d]  Stopped %s\n", job->id, last_cmdline);
+        break;
+      }
+      else if(WIFEXITED(status) || WIFSIGNALED(status))
+      {
+        //don't add finished jobs, but wait for every stage so none is left a zombie
+        spawned --;
+        if(stage == count - 1)
+        {
+          exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status) + 128;
+        }
+        stages[stage].pid = 0; //reaped, not part of the job if it gets stopped
+        stages[stage].usage = usage;
+        clock_gettime(CLOCK_MONOTONIC, &stages[stage].ended);
+      }
+    }
+    fg_pgid = 0;
+    if(timed && spawned == 0)
+    {
+      print_times(stages, count, &started);
+    }
+    return exit_code;
   }
-    trim(dest);
-    return 1;
+  return 0;
 }
 
 //execute commands while handline pipes, redirection and backgrounding, and tracks jobs for history
 static int execute(char *tokens[], int start, int end, int flag, char *last_cmdline)
 {
-  int count = 0;
-  char *argv_list[MAX_ARGS][MAX_ARGS];
-  char *input_file[MAX_ARGS];
-  char *output_file[MAX_ARGS];
-  int args[MAX_ARGS];
-  for(int i = 0; i < MAX_ARGS; i ++)
+  //time prefix, reported for foreground pipelines
+  int timed = 0;
+  if(start < end && strcmp(tokens[start], "time") == 0)
+  {
+    timed = 1;
+    start ++;
+  }
+  //every token lands in at most one argv, plus a NULL per stage; both arrays
+  //stay on the stack unless the command is unusually long
+  int max_stages = 1;
+  for(int i = start; i < end; i ++)
   {
-    input_file[i] = NULL;
-    output_file[i] = NULL;
-    args[i] = 0;
+    if(strcmp(tokens[i], "|") == 0)
+    {
+      max_stages ++;
+    }
   }
+  int slots = end - start + max_stages;
+  stage_t small_stages[MAX_ARGS];
+  char *small_args[MAX_TOKENS];
+  stage_t *stages = max_stages <= MAX_ARGS ? small_stages : malloc(sizeof(stage_t) * max_stages);
+  char **args = slots <= MAX_TOKENS ? small_args : malloc(sizeof(char *) * slots);
 
+  int count = 0;
+  int used = 0; //slots of args taken
   int current = start; //keep track of where we are
 
   while(current < end)
   {
-    int arg = 0;
-    int cmd = count;
+    stage_t *stage = &stages[count];
+    stage->argv = args + used;
+    stage->input_file = NULL;
+    stage->output_file = NULL;
+    stage->pid = -1;
+    memset(&stage->usage, 0, sizeof(stage->usage));
+    memset(&stage->ended, 0, sizeof(stage->ended));
     while(current < end && strcmp(tokens[current], "|") != 0) //parse the non-pipes
     {
       if(strcmp(tokens[current], "<") == 0) //check if< and also there is stuff after
@@ -554,7 +1882,7 @@ static int execute(char *tokens[], int start, int end, int flag, char *last_cmdl
         current ++; //skip past <
         if(current < end)
         {
-          input_file[cmd] = tokens[current];
+          stage->input_file = tokens[current];
           current ++;
         }
       }
@@ -563,19 +1891,19 @@ static int execute(char *tokens[], int start, int end, int flag, char *last_cmdl
         current ++; //skip past >
         if(current < end)
         {
-          output_file[cmd] = tokens[current];
+          stage->output_file = tokens[current];
           current ++;
         }
       }
       else
       {
-        argv_list[cmd][arg] = tokens[current];
-        arg ++;
+        args[used] = tokens[current];
+        used ++;
         current ++;
       }
     }
-    argv_list[cmd][arg] = NULL;
-    args[cmd] = arg;
+    args[used] = NULL;
+    used ++;
     count ++;
     if(current < end && strcmp(tokens[current], "|") == 0)
     {
@@ -583,176 +1911,367 @@ static int execute(char *tokens[], int start, int end, int flag, char *last_cmdl
       current ++;
     }
   }
-  if(count == 0)
+
+  int result = count == 0 ? 0 : run_pipeline(stages, count, flag, timed, last_cmdline);
+  if(stages != small_stages)
+  {
+    free(stages);
+  }
+  if(args != small_args)
   {
-    return 0;
+    free(args);
   }
+  return result;
+}
 
-  //builtin commands
-  if(count == 1 && flag == 0)
+//command lines for parallel
+typedef struct {
+  char **items;
+  int count, capacity;
+} line_list_t;
+
+static void add_line(line_list_t *lines, const char *line, size_t length)
+{
+  if(length == 0)
   {
-    int return_status;
-    if(cmd_handler(argv_list[0], &return_status))
-    {
-      return return_status;
-    }
+    return; //blank lines run nothing
+  }
+  if(lines->count == lines->capacity)
+  {
+    lines->capacity = lines->capacity == 0 ? 16 : 2 * lines->capacity;
+    lines->items = realloc(lines->items, sizeof(char *) * lines->capacity);
   }
-  //set up pipes
-  int (*pipes)[2] = NULL;
-  if(count > 1)
+  lines->items[lines->count] = strndup(line, length);
+  lines->count ++;
+}
+
+//every line up to the end of fd, 0 on a read error
+static int read_lines(int fd, line_list_t *lines)
+{
+  size_t size = SCRIPT_BLOCK, used = 0;
+  char *data = malloc(size);
+  ssize_t got;
+  while((got = read(fd, data + used, size - used)) != 0)
   {
-    pipes = malloc(sizeof(int[2]) * (count - 1));
-    for(int i = 0; i < count - 1; i ++)
+    if(got < 0)
     {
-      if(pipe(pipes[i]) < 0)
+      if(errno == EINTR)
       {
-        fprintf(stderr, "pipe error");
-        free(pipes);
-        return 1;
+        continue;
       }
+      free(data);
+      return 0;
+    }
+    used += got;
+    if(used == size)
+    {
+      size *= 2;
+      data = realloc(data, size);
     }
   }
-  pid_t pids[MAX_ARGS];
-  pid_t pgid = 0;
+  size_t start = 0;
+  for(size_t i = 0; i <= used; i ++)
+  {
+    if(i == used || data[i] == '\n')
+    {
+      add_line(lines, data + start, i - start);
+      start = i + 1;
+    }
+  }
+  free(data);
+  return 1;
+}
 
-  //launch commands
-  for(int i = 0; i < count; i++)
+//cmd with every {} replaced by arg, or arg added at the end if there is none
+static void add_template(line_list_t *lines, char **cmd, const char *arg)
+{
+  size_t length = 0;
+  for(int i = 0; cmd[i] != NULL; i ++)
   {
-    pid_t pid = fork();
-    if(pid < 0)
+    length += strlen(cmd[i]) * (strlen(arg) + 1) + 1; //at worst every char is a {}
+  }
+  length += strlen(arg) + 1;
+  char *line = malloc(length + 1);
+  char *p = line;
+  int used = 0;
+  for(int i = 0; cmd[i] != NULL; i ++)
+  {
+    if(i > 0)
     {
-      fprintf(stderr, "fork error");
-      if(pipes != NULL)
-      {
-        free(pipes);
-      }
-      return 1;
+      *p++ = ' ';
     }
-    if(pid == 0)
+    for(const char *c = cmd[i]; *c != '\0'; c ++)
     {
-      if(i == 0)
+      if(c[0] == '{' && c[1] == '}')
       {
-        setpgid(0, 0); //first one creates pgid
+        p = stpcpy(p, arg);
+        used = 1;
+        c ++;
       }
       else
       {
-        setpgid(0, pgid); //the rest join same pgid
+        *p++ = *c;
       }
+    }
+  }
+  if(!used)
+  {
+    *p++ = ' ';
+    p = stpcpy(p, arg);
+  }
+  add_line(lines, line, p - line);
+  free(line);
+}
 
-      signal(SIGINT, SIG_DFL); //default signal
-      signal(SIGTSTP, SIG_DFL);
+//start one line as a quiet background job, NULL if it could not be started
+static job_t* start_parallel(char *line, token_list_t *list)
+{
+  int n = tokenize(line, list);
+  for(int i = 0; i < n; i ++)
+  {
+    char *t = list->items[i];
+    if(strcmp(t, ";") == 0 || strcmp(t, "&&") == 0 || strcmp(t, "||") == 0 || strcmp(t, "&") == 0)
+    {
+      fprintf(stderr, "parallel: only pipelines can be run: %s\n", line);
+      return NULL;
+    }
+  }
+  job_t *before = last_job;
+  execute(list->items, 0, n, 2, line);
+  return last_job != before ? last_job : NULL;
+}
 
-      if(i > 0)
-      {
-        dup2(pipes[i - 1][0], STDIN_FILENO); //input from pipe
-      }
-      if(i < count - 1)
-      {
-        dup2(pipes[i][1], STDOUT_FILENO);
-      }
+//parallel [-j n] [-e] [-f file] [cmd ... ::: arg ...], keeps n commands running
+//as jobs and reports the exit status of each as it finishes
+static int parallel_cmd(char **argv)
+{
+  long limit = sysconf(_SC_NPROCESSORS_ONLN);
+  int stop_on_failure = 0;
+  const char *file = NULL;
+  int i = 1;
+  for(; argv[i] != NULL && argv[i][0] == '-'; i ++)
+  {
+    if(strcmp(argv[i], "-j") == 0 && argv[i + 1] != NULL && atoi(argv[i + 1]) > 0)
+    {
+      limit = atoi(argv[++ i]);
+    }
+    else if(strcmp(argv[i], "-e") == 0)
+    {
+      stop_on_failure = 1;
+    }
+    else if(strcmp(argv[i], "-f") == 0 && argv[i + 1] != NULL)
+    {
+      file = argv[++ i];
+    }
+    else
+    {
+      fprintf(stderr, "usage: parallel [-j n] [-e] [-f file] [cmd {} ::: args]\n");
+      return 2;
+    }
+  }
 
-      if(input_file[i] != NULL)
+  line_list_t lines = {NULL, 0, 0};
+  if(argv[i] != NULL)
+  {
+    int split = i;
+    while(argv[split] != NULL && strcmp(argv[split], ":::") != 0)
+    {
+      split ++;
+    }
+    if(argv[split] == NULL || file != NULL || split == i)
+    {
+      fprintf(stderr, "usage: parallel [-j n] [-e] [-f file] [cmd {} ::: args]\n");
+      return 2;
+    }
+    argv[split] = NULL; //ends cmd
+    for(int a = split + 1; argv[a] != NULL; a ++)
+    {
+      add_template(&lines, argv + i, argv[a]);
+    }
+    argv[split] = ":::";
+  }
+  else if(file != NULL)
+  {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if(fd < 0 || !read_lines(fd, &lines))
+    {
+      fprintf(stderr, "parallel: %s: %s\n", file, strerror(errno));
+      if(fd >= 0)
       {
-        int file = open(input_file[i], O_RDONLY); //open input file as read only
-        if(file < 0)
-        {
-          fprintf(stderr, "error opening input file during pipe\n");
-          _exit(127); //safe exit for fork
-        }
-        dup2(file, STDIN_FILENO);
-        close(file);
+        close(fd);
       }
-      if(output_file[i] != NULL)
+      return 2;
+    }
+    close(fd);
+  }
+  else if(input.fd == STDIN_FILENO)
+  {
+    //the rest of the shell's own input, lines it already read ahead included
+    char *line;
+    while((line = read_cmd()) != NULL)
+    {
+      add_line(&lines, line, strlen(line));
+    }
+  }
+  else
+  {
+    read_lines(STDIN_FILENO, &lines);
+  }
+
+  token_list_t list; //main's tokens are still in use
+  list.items = list.small;
+  list.capacity = MAX_TOKENS;
+  list.text.base = NULL;
+  list.text.size = 0;
+  list.text.used = 0;
+
+  //running[k] runs lines.items[line_of[k]]
+  job_t **running = malloc(sizeof(job_t *) * limit);
+  int *line_of = malloc(sizeof(int) * limit);
+  int active = 0, next = 0, failures = 0;
+  while(next < lines.count || active > 0)
+  {
+    while(active < limit && next < lines.count && !(stop_on_failure && failures > 0))
+    {
+      job_t *job = start_parallel(lines.items[next], &list);
+      if(job == NULL)
       {
-        int file = open(output_file[i], O_WRONLY | O_CREAT | O_TRUNC, 0666); //open output file with all these perms
-        if(file < 0)
-        {
-          fprintf(stderr, "error opening output file during pipe\n");
-          _exit(127); //safe exit for fork
-        }
-        dup2(file, STDOUT_FILENO);
-        close(file);
+        printf("parallel: [%d] exit 127: %s\n", next + 1, lines.items[next]);
+        failures ++;
       }
-      //close all pipe files
-      if(pipes != NULL)
+      else
       {
-        for(int j = 0; j < count - 1; j ++)
-        {
-          close(pipes[j][0]);
-          close(pipes[j][1]);
-        }
+        running[active] = job;
+        line_of[active] = next;
+        active ++;
       }
+      next ++;
+    }
+    if(active == 0)
+    {
+      break; //stopped early
+    }
 
-      //run command
-      if(argv_list[i][0] == NULL)
+    int status;
+    struct rusage usage;
+    pid_t pid = wait4(-1, &status, WUNTRACED | WCONTINUED, &usage);
+    if(pid < 0)
+    {
+      if(errno == EINTR)
       {
-        fprintf(stderr, "empty command\n");
-        _exit(127);
+        continue;
       }
-
-      //if failed
-      fprintf(stderr, "%s: command not found--Did you mean something else?\n", argv_list[i][0]);
-      _exit(127);
+      break;
     }
-    else
+    job_t *job = index_get(&jobs_by_pid, pid);
+    int k = 0;
+    while(k < active && running[k] != job)
     {
-      //this is if its a parent
-      pids[i] = pid;
-      if(i == 0)
-      {
-        pgid = pid;
-        setpgid(pid, pgid);
-      }
-      else
+      k ++;
+    }
+    if(k == active)
+    {
+      note_child(pid, status, &usage); //not one of ours
+      continue;
+    }
+    if(job_update(job, pid, status, &usage))
+    {
+      printf("parallel: [%d] exit %d: %s\n", line_of[k] + 1, job->exit_code, lines.items[line_of[k]]);
+      fflush(stdout);
+      if(job->exit_code != 0)
       {
-        setpgid(pid, pgid);
+        failures ++;
       }
-
+      remove_job(job);
+      active --;
+      running[k] = running[active];
+      line_of[k] = line_of[active];
     }
   }
-  if(pipes != NULL)
+
+  if(stop_on_failure && next < lines.count)
   {
-    for (int i = 0; i < count - 1; i ++) {
-      close(pipes[i][0]);
-      close(pipes[i][1]);
-    }
-    free(pipes); //free pipes at the end of execute
+    printf("parallel: %d not started after a failure\n", lines.count - next);
   }
-  if(flag != 0) //background job
+  for(int k = 0; k < lines.count; k ++)
   {
-    add_job(pgid, last_cmdline, JOB_RUNNING);
-    printf("[%d] %d running in background\n", next_job_id - 1, (int)pgid);
+    free(lines.items[k]);
   }
-  else //foreground job
+  free(lines.items);
+  free(running);
+  free(line_of);
+  if(list.items != list.small)
   {
-    fg_pgid = pgid;
-    int status;
-    pid_t wpid;
-    while((wpid = waitpid(-pgid, &status, WUNTRACED)) > 0)
+    free(list.items);
+  }
+  free(list.text.base);
+  return failures > 0 ? 1 : 0;
+}
+
+//pick the input: mini-shell [script | -c command], otherwise stdin; 0 or an exit status on error
+static int open_input(int argc, char **argv)
+{
+  if(argc > 1 && strcmp(argv[1], "-c") == 0)
+  {
+    if(argc < 3)
     {
-      if(WIFSTOPPED(status))
-      {
-        add_job(pgid, last_cmdline, JOB_STOPPED);
-        printf("\n[%d]  Stopped %s\n", next_job_id - 1, last_cmdline);
-        break;
-      }
-      else if(WIFEXITED(status) || WIFSIGNALED(status))
-      {
-        break; //don't add finished jobs
-      }
+      fprintf(stderr, "mini-shell: -c: option requires an argument\n");
+      return 2;
     }
-    fg_pgid = 0;
+    //the whole command is already in hand, read_cmd just splits its lines
+    input.end = strlen(argv[2]);
+    input.size = input.end + 1;
+    input.data = malloc(input.size);
+    memcpy(input.data, argv[2], input.size);
+    input.eof = 1;
+    input.fd = -1;
+    interactive = 0;
+  }
+  else if(argc > 1)
+  {
+    input.fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if(input.fd < 0)
+    {
+      fprintf(stderr, "mini-shell: %s: %s\n", argv[1], strerror(errno));
+      return 127;
+    }
+    interactive = 0;
+  }
+  else
+  {
+    interactive = isatty(STDIN_FILENO);
+  }
+  if(!interactive)
+  {
+    input.block = SCRIPT_BLOCK;
   }
   return 0;
 }
+
 int main(int argc, char** argv){
   // Please leave in this line as the first statement in your program.
   alarm(120); // This will terminate your shell after 120 seconds,
               // and is useful in the case that you accidently create a 'fork bomb'
 
-  char line[BUFFER_SIZE + 2];
-  char *tokens[MAX_TOKENS];
+  char *line;
+  token_list_t list;
+  list.items = list.small;
+  list.capacity = MAX_TOKENS;
+  list.text.base = NULL;
+  list.text.size = 0;
+  list.text.used = 0;
   int n; //number of tokens
+  int last = 0; //status of the last command
+
+  int error = open_input(argc, argv);
+  if(error != 0)
+  {
+    return error;
+  }
+  if(!interactive)
+  {
+    alarm(0); //scripts may run as long as they need
+  }
 
   struct sigaction sa_int = {0}, sa_tstp = {0};
   //ctrl c
@@ -769,34 +2288,48 @@ int main(int argc, char** argv){
   //Ignore ctrl \ bc spec doesnt say anything abt it
   signal(SIGQUIT, SIG_IGN);
 
+  init_history();
+  init_events();
+
   while(1)
   {
-    //continuously loop until quit or alarm sounds
-    reap(); //cleanup
-    printf("mini-shell>");
-    fflush(stdout);
+    //continuously loop until quit or alarm sounds, jobs are reaped while waiting for input
+    if(interactive)
+    {
+      printf("mini-shell>");
+      fflush(stdout);
+    }
 
     //read command line
-    if(!read_cmd(line, sizeof(line)))
+    if((line = read_cmd()) == NULL)
     {
-      printf("\n");
+      if(interactive)
+      {
+        printf("\n");
+      }
       break;
     }
     if(line[0] == '\0')
     {
       continue; //skip empty lines
     }
-    strncpy(last_cmd, line, BUFFER_SIZE);
-    add_history(line); //add to history
+    if(interactive)
+    {
+      add_history(line); //add to history, scripts are not recorded
+    }
+    //parallel reads the rest of the input through read_cmd, which moves its buffer,
+    //so the line the jobs are listed with is a copy
+    line = strdup(line);
 
     //tokenize
-    n = tokenize(line, tokens, MAX_TOKENS - 1);
+    n = tokenize(line, &list);
+    char **tokens = list.items;
     if(n == 0)
     {
+      free(line);
       continue; //nothing was parsed
     }
     int i = 0;
-    int last = 0;
     while(i < n)
     {
       int j = i;
@@ -811,13 +2344,11 @@ int main(int argc, char** argv){
       if(j > i && strcmp(tokens[j - 1], "&") == 0)
       {
         bg = 1;
-        tokens[j - 1] = NULL; //remove & token
-        j --;
       }
 
-      if(j > i)
+      if(j - bg > i)
       {
-        last = execute(tokens, i, j, bg, last_cmd); //execute command segments
+        last = execute(tokens, i, j - bg, bg, line); //execute command segments
       }
 
       //handle operators
@@ -868,8 +2399,14 @@ int main(int argc, char** argv){
         i = j + 1;
       }
     }
-    free_tokens(tokens, n);
+    free(line);
+  }
+  if(list.items != list.small)
+  {
+    free(list.items);
   }
+  free(list.text.base);
+  free(input.data);
   kill_all();
-  return 0;
+  return last;
 }
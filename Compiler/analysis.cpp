@@ -0,0 +1,186 @@
+#include "analysis.h"
+
+bool contains(const Stmt& stmt, std::initializer_list<Stmt::Kind> kinds)
+{
+    for (Stmt::Kind kind : kinds)
+    {
+        if (stmt.kind == kind)
+        {
+            return true;
+        }
+    }
+    for (const Stmt& inner : stmt.body)
+    {
+        if (contains(inner, kinds))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void collect(const Stmt& stmt, Stmt::Kind kind, std::vector<const Stmt*>& found)
+{
+    if (stmt.kind == kind)
+    {
+        found.push_back(&stmt);
+    }
+    for (const Stmt& inner : stmt.body)
+    {
+        collect(inner, kind, found);
+    }
+}
+
+bool assigns(const Stmt& stmt, const std::string& name)
+{
+    std::set<std::string> names;
+    assignedScalars(stmt, names);
+    return names.count(name) > 0;
+}
+
+bool reads(const Stmt& stmt, const std::string& name)
+{
+    std::set<std::string> names;
+    readScalars(stmt, names);
+    return names.count(name) > 0;
+}
+
+static void readScalars(const Expr* expr, std::set<std::string>& names)
+{
+    if (expr == nullptr)
+    {
+        return;
+    }
+    if (expr->kind == Expr::VARIABLE)
+    {
+        names.insert(expr->name);
+    }
+    readScalars(expr->left.get(), names);
+    readScalars(expr->right.get(), names);
+}
+
+bool reads(const Expr& expr, const std::string& name)
+{
+    std::set<std::string> names;
+    readScalars(&expr, names);
+    return names.count(name) > 0;
+}
+
+void assignedScalars(const Stmt& stmt, std::set<std::string>& names)
+{
+    if ((stmt.kind == Stmt::LET || stmt.kind == Stmt::INPUT) && !stmt.index)
+    {
+        names.insert(stmt.text);
+    }
+    for (const Stmt& inner : stmt.body)
+    {
+        assignedScalars(inner, names);
+    }
+}
+
+void readScalars(const Stmt& stmt, std::set<std::string>& names)
+{
+    readScalars(stmt.index.get(), names);
+    readScalars(stmt.expr.get(), names);
+    for (const Stmt& inner : stmt.body)
+    {
+        readScalars(inner, names);
+    }
+}
+
+static void indexedBy(const Expr* expr, const std::string& name, std::set<std::string>& arrays)
+{
+    if (expr == nullptr)
+    {
+        return;
+    }
+    if (expr->kind == Expr::INDEX && expr->left->kind == Expr::VARIABLE && expr->left->name == name)
+    {
+        arrays.insert(expr->name);
+    }
+    indexedBy(expr->left.get(), name, arrays);
+    indexedBy(expr->right.get(), name, arrays);
+}
+
+void indexedBy(const Stmt& stmt, const std::string& name, std::set<std::string>& arrays)
+{
+    if (stmt.index && stmt.index->kind == Expr::VARIABLE && stmt.index->name == name)
+    {
+        arrays.insert(stmt.text);
+    }
+    indexedBy(stmt.index.get(), name, arrays);
+    indexedBy(stmt.expr.get(), name, arrays);
+    for (const Stmt& inner : stmt.body)
+    {
+        indexedBy(inner, name, arrays);
+    }
+}
+
+bool isCountedLoop(const Stmt& loop)
+{
+    const Expr& cond = *loop.expr;
+    if (loop.kind != Stmt::WHILE || cond.kind != Expr::BINARY || (cond.op != "<" && cond.op != "<=") ||
+        cond.left->kind != Expr::VARIABLE ||
+        (cond.right->kind != Expr::NUMBER && cond.right->kind != Expr::VARIABLE) ||
+        loop.body.empty() || contains(loop, {Stmt::LABEL, Stmt::GOTO, Stmt::CALL}))
+    {
+        return false;
+    }
+
+    const std::string& var = cond.left->name;
+    if (cond.right->kind == Expr::VARIABLE && cond.right->name == var)
+    {
+        return false;
+    }
+
+    const Stmt& step = loop.body.back();
+    if (step.kind != Stmt::LET || step.index || step.text != var ||
+        step.expr->kind != Expr::BINARY || step.expr->op != "+")
+    {
+        return false;
+    }
+    const Expr& lhs = *step.expr->left;
+    const Expr& rhs = *step.expr->right;
+    bool increments = (lhs.kind == Expr::VARIABLE && lhs.name == var && rhs.kind == Expr::NUMBER && rhs.value == 1) ||
+                      (rhs.kind == Expr::VARIABLE && rhs.name == var && lhs.kind == Expr::NUMBER && lhs.value == 1);
+    if (!increments)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i + 1 < loop.body.size(); i++)
+    {
+        if (assigns(loop.body[i], var) ||
+            (cond.right->kind == Expr::VARIABLE && assigns(loop.body[i], cond.right->name)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string reductionOp(const Stmt& stmt, const std::string& name)
+{
+    if (stmt.kind != Stmt::LET || stmt.index || stmt.text != name ||
+        stmt.expr->kind != Expr::BINARY || (stmt.expr->op != "+" && stmt.expr->op != "*"))
+    {
+        return "";
+    }
+    const Expr& lhs = *stmt.expr->left;
+    if (lhs.kind != Expr::VARIABLE || lhs.name != name || reads(*stmt.expr->right, name))
+    {
+        return "";
+    }
+    return stmt.expr->op;
+}
+
+//operator of the first reduction update of name in stmt, empty if none
+std::string firstReductionOp(const Stmt& stmt, const std::string& name)
+{
+    std::string op = reductionOp(stmt, name);
+    for (size_t k = 0; op.empty() && k < stmt.body.size(); k++)
+    {
+        op = firstReductionOp(stmt.body[k], name);
+    }
+    return op;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <initializer_list>
+#include <set>
+#include <string>
+#include <vector>
+#include "ast.h"
+
+//does the statement or anything nested in it have one of the given kinds
+bool contains(const Stmt& stmt, std::initializer_list<Stmt::Kind> kinds);
+
+//the statement and everything nested in it that has the given kind
+void collect(const Stmt& stmt, Stmt::Kind kind, std::vector<const Stmt*>& found);
+
+//does the statement (or anything in it) assign / read the scalar name
+bool assigns(const Stmt& stmt, const std::string& name);
+bool reads(const Stmt& stmt, const std::string& name);
+bool reads(const Expr& expr, const std::string& name);
+
+//scalars the statement (or anything in it) assigns / reads
+void assignedScalars(const Stmt& stmt, std::set<std::string>& names);
+void readScalars(const Stmt& stmt, std::set<std::string>& names);
+
+//arrays subscripted with exactly the variable name
+void indexedBy(const Stmt& stmt, const std::string& name, std::set<std::string>& arrays);
+
+//while i < n (or <=) whose body ends in let i = i + 1, with nothing else
+//writing i or n and no jumps or calls in or out
+bool isCountedLoop(const Stmt& loop);
+
+//operator of a reduction update 'let name = name + e' (or *), where e does
+//not read name; empty when stmt is not one
+std::string reductionOp(const Stmt& stmt, const std::string& name);
+
+//operator of the first reduction update of name in stmt (or anything in it), empty if none
+std::string firstReductionOp(const Stmt& stmt, const std::string& name);
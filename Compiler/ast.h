@@ -0,0 +1,45 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Expr;
+using ExprPtr = std::unique_ptr<Expr>;
+
+//expression tree node
+struct Expr
+{
+    enum Kind { NUMBER, VARIABLE, UNARY, BINARY, INDEX };
+
+    Kind kind = NUMBER;
+    int value = 0;      //NUMBER
+    std::string name;   //VARIABLE, array of INDEX
+    std::string op;     //UNARY ("-", "!") or BINARY ("+", "<=", ...)
+    ExprPtr left;       //operand of UNARY, left side of BINARY, subscript of INDEX
+    ExprPtr right;      //right side of BINARY
+};
+
+//statement node, nested bodies belong to if/while/sub
+struct Stmt
+{
+    enum Kind { PRINT_STRING, PRINT_EXPR, INPUT, LET, IF, WHILE, LABEL, GOTO, DIM, SUB, CALL };
+
+    Kind kind = PRINT_STRING;
+    int line = 0;       //position of the statement keyword
+    int col = 0;
+    std::string text;   //string to print, variable/array/label name, sub name of SUB/CALL
+    ExprPtr expr;       //value to print/assign, if/while condition
+    ExprPtr index;      //subscript when input/let targets an array element
+    int size = 0;       //element count of DIM
+    bool parallel = false;                  //parallel while
+    std::vector<std::string> reductions;    //its reduce list
+    std::vector<Stmt> body;
+    int endLine = 0;    //position of endif/endwhile/endsub
+    int endCol = 0;
+};
+
+//whole parsed program
+struct Program
+{
+    std::vector<Stmt> statements;
+};
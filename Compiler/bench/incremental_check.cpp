@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <utility>
+#include "../emitter.h"
+#include "../generator.h"
+#include "../incremental.h"
+
+//checks applyEdit against parsing from scratch: random edits are applied to each
+//source, after every one the tokens, statement starts, symbols and the program
+//(compared through its generated C, with #line directives so positions count too)
+//must equal parseSource of the edited text, and both must fail with the same error.
+//prints one tab separated line per source with the time applyEdit and parseSource
+//took for the edits made to a valid source, in microseconds
+//
+//usage: incremental_check <source.basic>... [-n edits] [-s seed]
+
+// -----------------------------------------------------------------------------
+// Comparison
+// -----------------------------------------------------------------------------
+
+static std::string dumpTokens(const std::vector<Token>& tokens)
+{
+    std::ostringstream out;
+    for (const Token& token : tokens)
+    {
+        out << token.type << "|" << token.value << "|" << token.line << ":" << token.col
+            << "@" << token.offset << "+" << token.length << "\n";
+    }
+    return out.str();
+}
+
+static std::string dumpSymbols(const SymbolTable& symbols)
+{
+    std::vector<std::string> entries;
+    for (const auto& entry : symbols)
+    {
+        entries.push_back(entry.first + " " + std::to_string((int)entry.second.kind) + " " +
+                          std::to_string(entry.second.statement));
+    }
+    std::sort(entries.begin(), entries.end());
+    std::string out;
+    for (const std::string& entry : entries)
+    {
+        out += entry + "\n";
+    }
+    return out;
+}
+
+static std::string generatedCode(const Program& program)
+{
+    Emitter emitter;
+    emitter.enableLineDirectives("source", "source.c");
+    Generator generator(emitter);
+    generator.generate(program);
+    return emitter.getCode();
+}
+
+//what differs between the incrementally updated source and a fresh parse, empty if nothing
+static std::string difference(const ParsedSource& updated, const ParsedSource& fresh)
+{
+    if (dumpTokens(updated.tokens) != dumpTokens(fresh.tokens))
+    {
+        return "tokens";
+    }
+    if (updated.statementTokens != fresh.statementTokens)
+    {
+        return "statement starts";
+    }
+    if (dumpSymbols(updated.symbols) != dumpSymbols(fresh.symbols))
+    {
+        return "symbols";
+    }
+    if (generatedCode(updated.program) != generatedCode(fresh.program))
+    {
+        return "program";
+    }
+    return "";
+}
+
+// -----------------------------------------------------------------------------
+// Edits
+// -----------------------------------------------------------------------------
+
+//fragments typed into the source, whole statements and the pieces that break them
+static const char* const pieces[] = {
+    " ", "\n", "x", "1", ";", "=", "<", "[", "]", "\"", "#c", "i",
+    "print 5;", "let y = 2;\n", "let i = i + 1;", "dim q[4];",
+    "while i < 3 repeat", "endwhile", "if i > 2 then", "endif",
+    "sub s\n", "endsub", "call s;",
+};
+
+static TextEdit randomEdit(const std::string& text, std::mt19937& random)
+{
+    TextEdit edit;
+    edit.offset = random() % (text.size() + 1);
+    edit.removed = std::min<size_t>(random() % 4, text.size() - edit.offset);
+    edit.inserted = random() % 3 == 0 ? "" : pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+    return edit;
+}
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw std::runtime_error("cannot open " + path);
+    }
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static double microseconds(std::chrono::steady_clock::duration elapsed)
+{
+    return std::chrono::duration<double, std::micro>(elapsed).count();
+}
+
+//returns the number of mismatches
+static int checkSource(const std::string& path, int edits, unsigned seed)
+{
+    using clock = std::chrono::steady_clock;
+    std::mt19937 random(seed);
+    ParsedSource source = parseSource(readFile(path));
+    std::string lastValid = source.text;
+
+    std::vector<double> applyTimes, parseTimes;
+    int mismatches = 0, failed = 0;
+    bool undo = false;
+    TextEdit edit;
+    for (int i = 0; i < edits; i++)
+    {
+        //most edits that break the source are typed back out, so the source stays
+        //valid most of the time and the recovery from an invalid one is covered too
+        if (undo)
+        {
+            edit = TextEdit{0, source.text.size(), lastValid};
+        }
+        else
+        {
+            edit = randomEdit(source.text, random);
+        }
+        std::string expected = source.text;
+        expected.replace(edit.offset, edit.removed, edit.inserted);
+
+        //only edits to a valid source are timed, the others reparse everything
+        bool timed = source.valid && !undo;
+        std::string updatedError;
+        clock::time_point start = clock::now();
+        try
+        {
+            applyEdit(source, edit);
+        }
+        catch (const std::exception& error)
+        {
+            updatedError = error.what();
+        }
+        double applyTime = microseconds(clock::now() - start);
+
+        ParsedSource fresh;
+        std::string freshError;
+        start = clock::now();
+        try
+        {
+            fresh = parseSource(expected);
+        }
+        catch (const std::exception& error)
+        {
+            freshError = error.what();
+        }
+        if (timed)
+        {
+            applyTimes.push_back(applyTime);
+            parseTimes.push_back(microseconds(clock::now() - start));
+        }
+
+        std::string differs;
+        if (source.text != expected)
+        {
+            differs = "text";
+        }
+        else if (updatedError != freshError)
+        {
+            differs = "error \"" + updatedError + "\" instead of \"" + freshError + "\"";
+        }
+        else if (freshError.empty())
+        {
+            differs = difference(source, fresh);
+        }
+        if (!differs.empty())
+        {
+            mismatches++;
+            std::cerr << path << ": edit " << i << " (offset " << edit.offset << ", removed "
+                      << edit.removed << ", inserted \"" << edit.inserted << "\"): " << differs << "\n";
+            //carry on from a fresh parse so one bug is not reported for every later edit
+            source = std::move(fresh);
+            source.text = expected;
+        }
+
+        if (freshError.empty())
+        {
+            lastValid = expected;
+            undo = false;
+        }
+        else
+        {
+            failed++;
+            undo = random() % 4 != 0;
+        }
+    }
+
+    if (applyTimes.empty())
+    {
+        applyTimes.push_back(0);
+        parseTimes.push_back(0);
+    }
+    std::sort(applyTimes.begin(), applyTimes.end());
+    double applySum = 0, parseSum = 0;
+    for (size_t i = 0; i < applyTimes.size(); i++)
+    {
+        applySum += applyTimes[i];
+        parseSum += parseTimes[i];
+    }
+    size_t runs = applyTimes.size();
+    printf("%s\t%d\t%d\t%d\t%zu\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n", path.c_str(), edits, failed, mismatches, runs,
+           applySum / runs, applyTimes[runs / 2], applyTimes[(size_t)(runs * 0.99)], applyTimes[runs - 1],
+           parseSum / runs);
+    fflush(stdout);
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> paths;
+    int edits = 2000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+        {
+            edits = atoi(argv[++i]);
+        }
+        else if (arg == "-s" && i + 1 < argc)
+        {
+            seed = (unsigned)atoi(argv[++i]);
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty() || edits <= 0)
+    {
+        std::cerr << "usage: incremental_check <source.basic>... [-n edits] [-s seed]\n";
+        return 2;
+    }
+
+    printf("source\tedits\tinvalid\tmismatches\ttimed\tapply_mean_us\tapply_p50_us\tapply_p99_us\tapply_max_us\tparse_mean_us\n");
+    int mismatches = 0;
+    for (const std::string& path : paths)
+    {
+        try
+        {
+            mismatches += checkSource(path, edits, seed);
+        }
+        catch (const std::exception& error)
+        {
+            std::cerr << path << ": " << error.what() << "\n";
+            return 2;
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
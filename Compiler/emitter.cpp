@@ -1,4 +1,6 @@
 #include "emitter.h"
+#include <algorithm>
+#include <stdexcept>
 
 //add header like #include
 void Emitter::addHeader(const std::string& headerLine)
@@ -7,31 +9,217 @@ void Emitter::addHeader(const std::string& headerLine)
 }
 
 //declare the variable
-void Emitter::ensureVar(const std::string& variableName)
+void Emitter::ensureVar(const std::string& variableName, int initialValue)
 {
     if (declaredVars.find(variableName) == declaredVars.end())
     {
-        declarations << "int " << variableName << " = 0;\n";
+        declarations << (globalVariables ? "static int " : "int ") << variableName << " = " << initialValue << ";\n";
         declaredVars.insert(variableName);
     }
 }
 
+//arrays always live at file scope, cache-line aligned so gcc can vectorize over them
+void Emitter::ensureArray(const std::string& arrayName, int size, const std::vector<int>& initial)
+{
+    if (declaredVars.find(arrayName) != declaredVars.end())
+    {
+        return;
+    }
+
+    arrayDeclarations << "static int " << arrayName << "[" << size << "] __attribute__((aligned(64)))";
+    if (!initial.empty())
+    {
+        arrayDeclarations << " = {";
+        for (size_t i = 0; i < initial.size(); i++)
+        {
+            arrayDeclarations << (i > 0 ? ", " : "") << initial[i];
+        }
+        arrayDeclarations << "}";
+    }
+    arrayDeclarations << ";\n";
+    declaredVars.insert(arrayName);
+}
+
+//remember where the next lines come from
+void Emitter::setPosition(int line, int col)
+{
+    currentLine = line;
+    currentCol = col;
+}
+
 //add line of code toto body
 void Emitter::addLine(const std::string& codeLine)
 {
-    body << codeLine << "\n";
+    std::vector<BodyLine>& target = openFunctions.empty() ? body : functions[openFunctions.back()].body;
+    target.push_back({codeLine, currentLine, currentCol, currentFile});
+}
+
+void Emitter::useGlobalVariables()
+{
+    globalVariables = true;
+}
+
+void Emitter::beginFunction(const std::string& declarator)
+{
+    openFunctions.push_back(functions.size());
+    functions.push_back({declarator, {}});
+}
+
+void Emitter::endFunction()
+{
+    if (openFunctions.empty())
+    {
+        throw std::logic_error("endFunction without beginFunction");
+    }
+    openFunctions.pop_back();
+}
+
+void Emitter::endProgram(const std::string& declarator)
+{
+    Function f{declarator, {}};
+    if (!globalVariables)
+    {
+        std::istringstream lines(declarations.str());
+        for (std::string line; std::getline(lines, line);)
+        {
+            f.body.push_back({line, 0, 0, -1});
+        }
+        declarations.str("");
+        declaredVars.clear();
+    }
+    f.body.insert(f.body.end(), body.begin(), body.end());
+    f.body.push_back({"return 0;", 0, 0, -1});
+    functions.push_back(f);
+    body.clear();
+}
+
+void Emitter::setMainArguments()
+{
+    mainArguments = true;
+}
+
+void Emitter::enableLineDirectives(const std::string& file, const std::string& output)
+{
+    currentFile = (int)sourceFiles.size();
+    sourceFiles.push_back(file);
+    outputFile = output;
+}
+
+//quote a path for use inside a #line directive
+static std::string quotePath(const std::string& path)
+{
+    std::string quoted = "\"";
+    for (char c : path)
+    {
+        if (c == '\\' || c == '"')
+        {
+            quoted.push_back('\\');
+        }
+        quoted.push_back(c);
+    }
+    quoted += "\"";
+    return quoted;
 }
 
 //combine all into full code
 std::string Emitter::getCode() const
 {
-    std::string result;
+    std::string result = headers.str();
+
+    //C lines written so far
+    int written = (int)std::count(result.begin(), result.end(), '\n');
+    //position the compiler will assume for the next line without a directive
+    int expected = -1;
+    int expectedFile = -1;
+    //position of the last C line written, lines from the same .basic line are
+    //joined onto it so that a directive is only needed where the source jumps
+    int lastLine = -1;
+    int lastFile = -1;
+    auto append = [&](const std::string& code, int line, int file = -1) {
+        bool positioned = file >= 0 && line > 0;
+        if (positioned && line == lastLine && file == lastFile)
+        {
+            result.back() = ' ';
+            result += code + "\n";
+            return;
+        }
+        if (positioned && (line != expected || file != expectedFile))
+        {
+            result += "#line " + std::to_string(line) + " " + quotePath(sourceFiles[file]) + "\n";
+            written++;
+            expected = line;
+            expectedFile = file;
+        }
+        else if (!positioned && expectedFile >= 0)
+        {
+            //glue the generator added is the output's own again, not the last .basic line's
+            written++;
+            result += "#line " + std::to_string(written + 1) + " " + quotePath(outputFile) + "\n";
+            expectedFile = -1;
+        }
+        result += code + "\n";
+        written++;
+        if (expected >= 0)
+        {
+            expected++;
+        }
+        lastLine = positioned ? line : -1;
+        lastFile = file;
+    };
+
+    auto appendDeclarations = [&](const std::stringstream& text) {
+        std::istringstream lines(text.str());
+        for (std::string line; std::getline(lines, line);)
+        {
+            append(line, 0);
+        }
+    };
+
+    if (globalVariables || !arrayDeclarations.str().empty())
+    {
+        append("", 0);
+    }
+    appendDeclarations(arrayDeclarations);
+    if (globalVariables)
+    {
+        appendDeclarations(declarations);
+    }
+    //helpers can call each other in any order
+    if (!functions.empty())
+    {
+        append("", 0);
+    }
+    for (const Function& f : functions)
+    {
+        append("static " + f.declarator + ";", 0);
+    }
+    for (const Function& f : functions)
+    {
+        append("", 0);
+        //kept out of line, otherwise gcc folds single-call helpers straight back into main
+        append("static __attribute__((noinline)) " + f.declarator, 0);
+        append("{", 0);
+        for (const BodyLine& b : f.body)
+        {
+            append(b.code, b.line, b.file);
+        }
+        append("}", 0);
+    }
+
+    append("", 0);
+    append(mainArguments ? "int main(int argc, char** argv)" : "int main()", 0);
+    append("{", 0);
+    if (!globalVariables)
+    {
+        appendDeclarations(declarations);
+    }
+    for (const BodyLine& b : body)
+    {
+        append(b.code, b.line, b.file);
+    }
 
-    result += headers.str();
-    result += "\nint main()\n{\n";
-    result += declarations.str();
-    result += body.str();
-    result += "    return 0;\n}\n";
+    append("    return 0;", 0);
+    append("}", 0);
 
     return result;
 }
@@ -2,6 +2,7 @@
 #include <string>
 #include <unordered_set>
 #include <sstream>
+#include <vector>
 
 class Emitter
 {
@@ -10,17 +11,73 @@ public:
     void addHeader(const std::string& headerLine);
 
     //declare variables only once
-    void ensureVar(const std::string& variableName);
+    void ensureVar(const std::string& variableName, int initialValue = 0);
+
+    //declare a file-scope array once, initial holds the leading elements
+    void ensureArray(const std::string& arrayName, int size, const std::vector<int>& initial);
+
+    //source position of the statement being emitted
+    void setPosition(int line, int col);
 
     //add line
     void addLine(const std::string& codeLine);
 
+    //write #line directives pointing back at sourceFile (for the lines added
+    //from now on, a bundle calls it again for every program); the lines added for
+    //one .basic line then share one C line, and lines added at position 0 are
+    //pointed back at outputFile, the .c the code is written to
+    void enableLineDirectives(const std::string& sourceFile, const std::string& outputFile);
+
+    //declare variables at file scope so helper functions can share them
+    //(call before the first ensureVar)
+    void useGlobalVariables();
+
+    //lines go into a static helper function until the matching endFunction(),
+    //declarator is e.g. "void region_1(void)"; helpers may be started inside helpers
+    void beginFunction(const std::string& declarator);
+    void endFunction();
+
+    //everything emitted for main() so far becomes the static function declarator,
+    //and main() starts out empty again
+    void endProgram(const std::string& declarator);
+
+    //main(argc, argv) rather than main()
+    void setMainArguments();
+
     //final C code as a single string
     std::string getCode() const;
 
 private:
+    //one line of main() and the .basic position it came from
+    struct BodyLine
+    {
+        std::string code;
+        int line;
+        int col;
+        int file;   //index in sourceFiles, -1 = no #line
+    };
+
+    //helper function split out of main()
+    struct Function
+    {
+        std::string declarator;
+        std::vector<BodyLine> body;
+    };
+
     std::stringstream headers;
     std::stringstream declarations;
-    std::stringstream body;
+    std::stringstream arrayDeclarations;
+    std::vector<BodyLine> body;
+    std::vector<Function> functions;
     std::unordered_set<std::string> declaredVars;
+
+    bool globalVariables = false;
+    bool mainArguments = false;
+    std::vector<size_t> openFunctions; //innermost last
+
+    int currentLine = 0;
+    int currentCol = 0;
+    std::vector<std::string> sourceFiles;
+    int currentFile = -1;   //-1 = no #line directives
+    std::string outputFile;
 };
@@ -0,0 +1,170 @@
+#include "executor.h"
+#include <climits>
+#include <stdexcept>
+#include <vector>
+
+RunState::RunState(const ModuleView& module)
+    : vars(module.header->varCount, 0)
+{
+    for (uint32_t i = 0; i < module.header->arrayCount; i++)
+    {
+        arrays.emplace_back(module.arrays[i].size, 0);
+    }
+}
+
+int execute(const ModuleView& module, FILE* in, FILE* out)
+{
+    RunState state(module);
+    return run(module, state, in, out, UINT64_MAX) == RunStatus::HALTED ? 0 : 1;
+}
+
+//element of an array, checked like the generated C does
+static int32_t& element(RunState& state, int32_t array, int32_t index)
+{
+    std::vector<int32_t>& elements = state.arrays[array];
+    if (index < 0 || (size_t)index >= elements.size())
+    {
+        throw std::runtime_error("array index out of bounds");
+    }
+    return elements[index];
+}
+
+//deepest sub recursion before the run fails, instead of the generated C's stack
+static const size_t MAX_CALL_DEPTH = 1 << 20;
+
+RunStatus run(const ModuleView& module, RunState& state, FILE* in, FILE* out, uint64_t maxSteps)
+{
+    int32_t* vars = state.vars.data();
+    std::vector<int32_t> stack(module.header->maxStack + 1);
+    int32_t* sp = stack.data(); //next free slot
+    std::vector<uint32_t> returns;
+
+    //arithmetic wraps like the generated C does in practice
+    auto wrap = [](int64_t v) { return (int32_t)(uint32_t)v; };
+
+    uint32_t pc = 0;
+    while (true)
+    {
+        const Instr& instr = module.code[pc++];
+        switch ((Op)instr.op)
+        {
+        case Op::HALT:
+            return RunStatus::HALTED;
+
+        case Op::CONST: *sp++ = instr.arg; break;
+        case Op::LOAD:  *sp++ = vars[instr.arg]; break;
+        case Op::STORE: vars[instr.arg] = *--sp; break;
+
+        case Op::NEG: sp[-1] = wrap(-(int64_t)sp[-1]); break;
+        case Op::NOT: sp[-1] = !sp[-1]; break;
+
+        case Op::ADD: sp--; sp[-1] = wrap((int64_t)sp[-1] + sp[0]); break;
+        case Op::SUB: sp--; sp[-1] = wrap((int64_t)sp[-1] - sp[0]); break;
+        case Op::MUL: sp--; sp[-1] = wrap((int64_t)sp[-1] * sp[0]); break;
+        case Op::DIV:
+            sp--;
+            if (sp[0] == 0 || (sp[-1] == INT_MIN && sp[0] == -1))
+            {
+                throw std::runtime_error("division overflow or by zero");
+            }
+            sp[-1] = sp[-1] / sp[0];
+            break;
+
+        case Op::EQ: sp--; sp[-1] = sp[-1] == sp[0]; break;
+        case Op::NE: sp--; sp[-1] = sp[-1] != sp[0]; break;
+        case Op::LT: sp--; sp[-1] = sp[-1] < sp[0]; break;
+        case Op::LE: sp--; sp[-1] = sp[-1] <= sp[0]; break;
+        case Op::GT: sp--; sp[-1] = sp[-1] > sp[0]; break;
+        case Op::GE: sp--; sp[-1] = sp[-1] >= sp[0]; break;
+
+        case Op::PRINT_INT:
+            std::fprintf(out, "%d\n", *--sp);
+            break;
+
+        case Op::PRINT_STR:
+        {
+            const StringRef& ref = module.strings[instr.arg];
+            std::fwrite(module.pool + ref.offset, 1, ref.length, out);
+            std::fputc('\n', out);
+            break;
+        }
+
+        case Op::INPUT:
+            if (in == nullptr)
+            {
+                return RunStatus::INPUT_ERROR;
+            }
+            if (std::fscanf(in, "%d", &vars[instr.arg]) != 1)
+            {
+                std::fprintf(stderr, "Input error\n");
+                return RunStatus::INPUT_ERROR;
+            }
+            break;
+
+        case Op::ALOAD:
+            sp[-1] = element(state, instr.arg, sp[-1]);
+            break;
+
+        case Op::ASTORE:
+            sp -= 2;
+            element(state, instr.arg, sp[0]) = sp[1];
+            break;
+
+        case Op::AINPUT:
+        {
+            int32_t& target = element(state, instr.arg, *--sp);
+            if (in == nullptr)
+            {
+                return RunStatus::INPUT_ERROR;
+            }
+            if (std::fscanf(in, "%d", &target) != 1)
+            {
+                std::fprintf(stderr, "Input error\n");
+                return RunStatus::INPUT_ERROR;
+            }
+            break;
+        }
+
+        case Op::JUMP:
+            if (maxSteps-- == 0)
+            {
+                return RunStatus::OUT_OF_STEPS;
+            }
+            pc = (uint32_t)instr.arg;
+            break;
+
+        case Op::JUMP_IF_FALSE:
+            if (*--sp == 0)
+            {
+                pc = (uint32_t)instr.arg;
+            }
+            break;
+
+        case Op::CALL:
+            if (maxSteps-- == 0)
+            {
+                return RunStatus::OUT_OF_STEPS;
+            }
+            if (returns.size() == MAX_CALL_DEPTH)
+            {
+                throw std::runtime_error("sub calls nested too deeply");
+            }
+            returns.push_back(pc);
+            pc = (uint32_t)instr.arg;
+            break;
+
+        case Op::RET:
+            //only reachable without a call in a hand-made module
+            if (returns.empty())
+            {
+                throw std::runtime_error("return without a call");
+            }
+            pc = returns.back();
+            returns.pop_back();
+            break;
+
+        case Op::OP_COUNT:
+            return RunStatus::HALTED;
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "ir.h"
+
+//how a bounded run ended
+enum class RunStatus { HALTED, INPUT_ERROR, OUT_OF_STEPS };
+
+//variables and array elements of a module, all starting at zero
+struct RunState
+{
+    explicit RunState(const ModuleView& module);
+
+    std::vector<int32_t> vars;
+    std::vector<std::vector<int32_t>> arrays;
+};
+
+//core interpreter loop; state keeps the final values,
+//maxSteps bounds the loop iterations, gotos and calls taken
+RunStatus run(const ModuleView& module, RunState& state, FILE* in, FILE* out, uint64_t maxSteps);
+
+//run a validated module in-process, reading input from in and printing to out
+//returns the exit code the equivalent generated C program would have
+int execute(const ModuleView& module, FILE* in, FILE* out);
@@ -0,0 +1,946 @@
+#include "generator.h"
+#include "analysis.h"
+#include "runtime.h"
+#include <algorithm>
+#include <climits>
+
+//subs of at most this many statements, counting the subs inlined into them,
+//are inlined at every call
+static const size_t INLINE_LIMIT = 8;
+
+//statements all the copies of inlined subs may add to a program
+static const size_t INLINE_GROWTH_LIMIT = 1000;
+
+Generator::Generator(Emitter& emitterInstance)
+    : emitter(emitterInstance)
+{
+}
+
+void Generator::generate(const Program& program)
+{
+    generate(program, Precomputed());
+}
+
+void Generator::generate(const Program& program, const Precomputed& precomputed)
+{
+    if (!runtimeDeclared)
+    {
+        declareRuntime();
+    }
+
+    planSubs(program, precomputed.statementCount);
+    bool outOfLine = std::any_of(subs.begin(), subs.end(),
+                                 [](const std::pair<const std::string, SubPlan>& s) { return !s.second.inlined && s.second.calls > 0; });
+    if (outlineSize > 0 || outOfLine)
+    {
+        emitter.useGlobalVariables();
+    }
+
+    known = &precomputed;
+    arraySizes.clear();
+    declareArrays(program);
+
+    size_t first = precomputed.statementCount;
+    if (first > 0)
+    {
+        emitter.setPosition(program.statements[0].line, program.statements[0].col);
+        writeOutput(precomputed.output);
+    }
+    //subs defined by the precomputed statements may still be called by the rest
+    for (size_t i = 0; i < first; i++)
+    {
+        if (program.statements[i].kind == Stmt::SUB)
+        {
+            statement(program.statements[i]);
+        }
+    }
+
+    block(program.statements, first);
+    known = nullptr;
+}
+
+//the program becomes static int basic_program_N(void), with every name prefixed
+//by pN_ so that it cannot clash with the other programs of the bundle
+void Generator::generateMember(const std::string& name, const Program& program, const Precomputed& precomputed)
+{
+    members.push_back(name);
+    std::string n = std::to_string(members.size());
+
+    prefix = "p" + n + "_";
+    generate(program, precomputed);
+    prefix.clear();
+
+    emitter.endProgram("int basic_program_" + n + "(void)");
+}
+
+//main runs the program named by argv[0] (a link to the bundle) or by argv[1]
+void Generator::generateDispatcher()
+{
+    emitter.addHeader("");
+    emitter.addHeader("//basename of path equals name");
+    emitter.addHeader("static int basic_is(const char* path, const char* name)");
+    emitter.addHeader("{");
+    emitter.addHeader("    const char* base = path;");
+    emitter.addHeader("    for (const char* p = path; *p; p++) if (*p == '/') base = p + 1;");
+    emitter.addHeader("    while (*base && *base == *name) { base++; name++; }");
+    emitter.addHeader("    return *base == *name;");
+    emitter.addHeader("}");
+
+    std::string usage = "Usage: <program> or bundle <program>\nPrograms:";
+    emitter.setPosition(0, 0);
+    emitter.setMainArguments();
+    emitter.addLine("static const struct { const char* name; int (*run)(void); } basic_programs[] = {");
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        emitter.addLine("    {\"" + escapeString(members[i]) + "\", basic_program_" + std::to_string(i + 1) + "},");
+        usage += " " + members[i];
+    }
+    emitter.addLine("};");
+    emitter.addLine("for (int basic_arg = 0; basic_arg < argc && basic_arg < 2; basic_arg++) {");
+    emitter.addLine("for (int basic_p = 0; basic_p < (int)(sizeof(basic_programs) / sizeof(basic_programs[0])); basic_p++) {");
+    emitter.addLine("if (basic_is(argv[basic_arg], basic_programs[basic_p].name)) return basic_programs[basic_p].run();");
+    emitter.addLine("}");
+    emitter.addLine("}");
+    if (freestanding)
+    {
+        emitter.addLine("basic_fail(\"" + escapeString(usage + "\n") + "\");");
+    }
+    else
+    {
+        emitter.addLine("fputs(\"" + escapeString(usage + "\n") + "\", stderr);");
+        emitter.addLine("return 1;");
+    }
+}
+
+void Generator::setOutlining(size_t maxStatements)
+{
+    outlineSize = maxStatements;
+}
+
+void Generator::setFreestanding(bool enabled)
+{
+    freestanding = enabled;
+}
+
+//libc, or the freestanding runtime
+void Generator::declareRuntime()
+{
+    runtimeDeclared = true;
+    if (freestanding)
+    {
+        if (!members.empty())
+        {
+            emitter.addHeader("#define BASIC_MAIN_ARGS");
+        }
+        emitter.addHeader(freestandingRuntime());
+    }
+    else
+    {
+        emitter.addHeader("#include <stdio.h>");
+        emitter.addHeader("#include <stdlib.h>");
+    }
+}
+
+//C name of a .basic variable or array
+std::string Generator::cname(const std::string& name) const
+{
+    return prefix + name;
+}
+
+//statement count including everything nested
+size_t Generator::statementSize(const Stmt& stmt)
+{
+    size_t size = 1;
+    for (const Stmt& inner : stmt.body)
+    {
+        size += statementSize(inner);
+    }
+    return size;
+}
+
+//emit list[first, stop), moving goto-free runs into helper functions when it is too big
+void Generator::block(const std::vector<Stmt>& list, size_t first, size_t stop)
+{
+    stop = std::min(stop, list.size());
+
+    size_t total = 0;
+    for (size_t i = first; i < stop; i++)
+    {
+        total += statementSize(list[i]);
+    }
+
+    if (outlineSize == 0 || inRegion || total <= outlineSize)
+    {
+        for (size_t i = first; i < stop; i++)
+        {
+            statement(list[i]);
+        }
+        return;
+    }
+
+    size_t i = first;
+    while (i < stop)
+    {
+        //labels and gotos have to stay in the same C function; big
+        //statements stay too, but their body gets split up in turn
+        if (contains(list[i], {Stmt::LABEL, Stmt::GOTO, Stmt::SUB}) || statementSize(list[i]) > outlineSize)
+        {
+            statement(list[i]);
+            i++;
+            continue;
+        }
+
+        size_t end = i;
+        size_t size = 0;
+        while (end < stop && !contains(list[end], {Stmt::LABEL, Stmt::GOTO, Stmt::SUB}) &&
+               size + statementSize(list[end]) <= outlineSize)
+        {
+            size += statementSize(list[end]);
+            end++;
+        }
+        region(list, i, end);
+        i = end;
+    }
+}
+
+//move list[begin, end) into its own function and call it in place
+void Generator::region(const std::vector<Stmt>& list, size_t begin, size_t end)
+{
+    std::string name = "region_" + std::to_string(++regionCount);
+
+    emitter.setPosition(list[begin].line, list[begin].col);
+    emitter.addLine(name + "();");
+
+    emitter.beginFunction("void " + name + "(void)");
+    inRegion = true;
+    for (size_t i = begin; i < end; i++)
+    {
+        statement(list[i]);
+    }
+    inRegion = false;
+    emitter.endFunction();
+}
+
+// ---------------------------------------------
+// Subs
+// ---------------------------------------------
+
+//decide, for every sub of the program, whether its calls get a copy of the body;
+//only calls that still run count, not those in the first precomputed statements
+//or in subs nothing calls
+void Generator::planSubs(const Program& program, size_t precomputed)
+{
+    subs.clear();
+    std::unordered_map<std::string, std::vector<std::string>> callees;
+    std::vector<const Stmt*> calls;
+    for (const Stmt& stmt : program.statements)
+    {
+        if (stmt.kind == Stmt::SUB)
+        {
+            subs[stmt.text] = {&stmt, 0, 0, false};
+            std::vector<const Stmt*> inner;
+            collect(stmt, Stmt::CALL, inner);
+            for (const Stmt* call : inner)
+            {
+                callees[stmt.text].push_back(call->text);
+            }
+        }
+    }
+    for (size_t i = precomputed; i < program.statements.size(); i++)
+    {
+        if (program.statements[i].kind != Stmt::SUB)
+        {
+            collect(program.statements[i], Stmt::CALL, calls);
+        }
+    }
+    //a sub's own calls count from its first call on
+    for (size_t i = 0; i < calls.size(); i++)
+    {
+        SubPlan& plan = subs.at(calls[i]->text);
+        if (plan.calls++ == 0)
+        {
+            collect(*plan.sub, Stmt::CALL, calls);
+        }
+    }
+
+    //can the sub end up calling itself
+    auto recursive = [&](const std::string& name) {
+        std::set<std::string> seen;
+        std::function<bool(const std::string&)> reaches = [&](const std::string& from) {
+            for (const std::string& to : callees[from])
+            {
+                if (to == name || (seen.insert(to).second && reaches(to)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+        return reaches(name);
+    };
+
+    //size with the calls to inlined subs replaced by their bodies; a sub has to be
+    //defined before it is called, so its callees are planned by the time it is
+    std::function<size_t(const Stmt&)> inlinedSize = [&](const Stmt& stmt) {
+        auto found = stmt.kind == Stmt::CALL ? subs.find(stmt.text) : subs.end();
+        if (found != subs.end() && found->second.inlined)
+        {
+            return found->second.size;
+        }
+        size_t size = 1;
+        for (const Stmt& inner : stmt.body)
+        {
+            size += inlinedSize(inner);
+        }
+        return size;
+    };
+
+    size_t growth = 0;
+    for (const Stmt& stmt : program.statements)
+    {
+        if (stmt.kind != Stmt::SUB)
+        {
+            continue;
+        }
+        SubPlan& plan = subs.at(stmt.text);
+        plan.size = inlinedSize(stmt) - 1;
+        size_t size = plan.size;
+        //every call but one is an extra copy of the body
+        size_t added = (plan.calls - (plan.calls > 0)) * size;
+        std::string why;
+        if (plan.calls == 0)
+        {
+            why = "dropped, never called";
+        }
+        else if (recursive(stmt.text))
+        {
+            why = "out of line, recursive";
+        }
+        else if (contains(stmt, {Stmt::LABEL}))
+        {
+            //the labels could clash with the caller's
+            why = "out of line, has labels";
+        }
+        else if (plan.calls == 1)
+        {
+            plan.inlined = true;
+            why = "inlined";
+        }
+        else if (size > INLINE_LIMIT)
+        {
+            why = "out of line";
+        }
+        else if (growth + added > INLINE_GROWTH_LIMIT)
+        {
+            why = "out of line, inlining budget used up";
+        }
+        else
+        {
+            plan.inlined = true;
+            growth += added;
+            why = "inlined";
+        }
+        report.push_back("line " + std::to_string(stmt.line) + ": sub " + stmt.text + " (" +
+                         std::to_string(size) + (size == 1 ? " statement, " : " statements, ") +
+                         std::to_string(plan.calls) + (plan.calls == 1 ? " call): " : " calls): ") + why);
+    }
+}
+
+//C function of a sub kept out of line
+std::string Generator::subName(const std::string& name) const
+{
+    return "basic_sub_" + prefix + name;
+}
+
+// ---------------------------------------------
+// Arrays
+// ---------------------------------------------
+
+//note the array sizes and declare the bounds check they use; the arrays
+//themselves are declared by their first use, so none the code no longer reads
+//or writes (after precomputing) is left behind
+void Generator::declareArrays(const Program& program)
+{
+    std::vector<std::reference_wrapper<const Stmt>> all = dims(program.statements);
+    if (!all.empty() && !boundsDeclared)
+    {
+        declareBoundsCheck();
+    }
+
+    for (const Stmt& dim : all)
+    {
+        arraySizes[dim.text] = dim.size;
+    }
+}
+
+//file-scope whatever block its dim appears in, with the values left by the
+//precomputed statements, if any
+void Generator::declareArray(const std::string& array)
+{
+    std::vector<int> initial;
+    auto found = known->arrays.find(array);
+    if (found != known->arrays.end())
+    {
+        initial = found->second;
+        while (!initial.empty() && initial.back() == 0)
+        {
+            initial.pop_back();
+        }
+    }
+    emitter.ensureArray(cname(array), arraySizes.at(array), initial);
+}
+
+//out-of-range subscripts end the program, like a failed input
+void Generator::declareBoundsCheck()
+{
+    boundsDeclared = true;
+    emitter.addHeader("");
+    emitter.addHeader("static void basic_bounds_error(void) __attribute__((noreturn, cold));");
+    if (freestanding)
+    {
+        emitter.addHeader("static void basic_bounds_error(void) { basic_fail(\"Array index out of bounds\\n\"); }");
+    }
+    else
+    {
+        emitter.addHeader("static void basic_bounds_error(void) { fprintf(stderr, \"Array index out of bounds\\n\"); exit(1); }");
+    }
+    emitter.addHeader("static inline __attribute__((unused)) int basic_index(int i, int n) { if ((unsigned)i >= (unsigned)n) basic_bounds_error(); return i; }");
+}
+
+//dim statements in source order
+std::vector<std::reference_wrapper<const Stmt>> Generator::dims(const std::vector<Stmt>& list)
+{
+    std::vector<std::reference_wrapper<const Stmt>> found;
+    for (const Stmt& stmt : list)
+    {
+        if (stmt.kind == Stmt::DIM)
+        {
+            found.push_back(stmt);
+        }
+        for (const Stmt& inner : dims(stmt.body))
+        {
+            found.push_back(inner);
+        }
+    }
+    return found;
+}
+
+//array[index], bounds checked unless the index is known to be in range
+std::string Generator::subscript(const std::string& array, const Expr& index)
+{
+    int size = arraySizes.at(array);
+    declareArray(array);
+    std::string i = expression(index);
+
+    bool safe = index.kind == Expr::NUMBER && index.value >= 0 && index.value < size;
+    for (const auto& loop : checkedLoops)
+    {
+        safe = safe || (index.kind == Expr::VARIABLE && index.name == loop.first && loop.second.count(array));
+    }
+
+    if (safe)
+    {
+        return cname(array) + "[" + i + "]";
+    }
+    return cname(array) + "[basic_index(" + i + ", " + std::to_string(size) + ")]";
+}
+
+// ---------------------------------------------
+// Counted loops
+// ---------------------------------------------
+
+//emit a counted loop as a for loop; when its counter indexes arrays, add a copy
+//without per-access bounds checks guarded by one check of the whole range
+void Generator::countedLoop(const Stmt& loop)
+{
+    const Expr& cond = *loop.expr;
+    const std::string& var = cond.left->name;
+    std::string header = "for (; " + expression(cond) + "; " + cname(var) + "++) {";
+
+    std::set<std::string> arrays;
+    std::string guard;
+    if (cond.right->kind == Expr::NUMBER)
+    {
+        int last = cond.op == "<" ? cond.right->value - 1 : cond.right->value;
+        guard = rangeGuard(loop, std::to_string(last + 1), last, arrays);
+    }
+    else
+    {
+        std::string end = expression(*cond.right) + (cond.op == "<" ? "" : " + 1");
+        guard = rangeGuard(loop, end, -1, arrays);
+    }
+    versionedLoop(loop, header, guard, arrays);
+}
+
+//condition under which the counter stays inside every array it indexes while it
+//runs up to end (exclusive), empty when there are none or it can never hold;
+//last is the final counter value when known at compile time, else -1
+std::string Generator::rangeGuard(const Stmt& loop, const std::string& end, int last, std::set<std::string>& arrays)
+{
+    const std::string& var = loop.expr->left->name;
+    for (size_t i = 0; i + 1 < loop.body.size(); i++)
+    {
+        indexedBy(loop.body[i], var, arrays);
+    }
+    if (arrays.empty())
+    {
+        return "";
+    }
+
+    int smallest = INT_MAX;
+    for (const std::string& array : arrays)
+    {
+        smallest = std::min(smallest, arraySizes.at(array));
+    }
+
+    if (last >= 0)
+    {
+        return last < smallest ? cname(var) + " >= 0" : "";
+    }
+    return cname(var) + " >= 0 && " + end + " <= " + std::to_string(smallest);
+}
+
+//header, the loop body without its increment and the closing brace, plus a
+//copy without bounds checks on the arrays when guard holds
+void Generator::versionedLoop(const Stmt& loop, const std::string& header, const std::string& guard,
+                              const std::set<std::string>& arrays)
+{
+    const std::string& var = loop.expr->left->name;
+    size_t bodyEnd = loop.body.size() - 1;
+
+    if (!guard.empty())
+    {
+        emitter.addLine("if (" + guard + ") {");
+        checkedLoops.push_back({var, arrays});
+        emitter.addLine(header);
+        block(loop.body, 0, bodyEnd);
+        emitter.setPosition(loop.endLine, loop.endCol);
+        emitter.addLine("}");
+        checkedLoops.pop_back();
+        emitter.addLine("} else {");
+        emitter.setPosition(loop.line, loop.col);
+    }
+
+    emitter.addLine(header);
+    block(loop.body, 0, bodyEnd);
+    emitter.setPosition(loop.endLine, loop.endCol);
+    emitter.addLine("}");
+
+    if (!guard.empty())
+    {
+        emitter.addLine("}");
+    }
+}
+
+// ---------------------------------------------
+// Parallel loops
+// ---------------------------------------------
+
+//thread count helper shared by every parallel loop
+void Generator::declareThreads()
+{
+    emitter.addHeader("#include <pthread.h>");
+    emitter.addHeader("#include <unistd.h>");
+    emitter.addHeader("");
+    emitter.addHeader("#define BASIC_MAX_THREADS 256");
+    emitter.addHeader("");
+    emitter.addHeader("//BASIC_THREADS overrides the core count; short loops stay on fewer threads");
+    emitter.addHeader("static int basic_threads(long long trip)");
+    emitter.addHeader("{");
+    emitter.addHeader("    const char* env = getenv(\"BASIC_THREADS\");");
+    emitter.addHeader("    long long n = env != NULL ? atoll(env) : sysconf(_SC_NPROCESSORS_ONLN);");
+    emitter.addHeader("    long long most = env != NULL ? trip : trip / 1024;");
+    emitter.addHeader("    n = n < most ? n : most;");
+    emitter.addHeader("    n = n < BASIC_MAX_THREADS ? n : BASIC_MAX_THREADS;");
+    emitter.addHeader("    return n < 1 ? 1 : (int)n;");
+    emitter.addHeader("}");
+}
+
+//the iteration range is cut into one chunk per thread; each worker gets its own
+//copy of the scalars, reductions start at their identity and are combined in
+//chunk order afterwards, other assigned scalars keep the last chunk's values
+void Generator::parallelLoop(const Stmt& loop)
+{
+    if (parallelCount == 0)
+    {
+        declareThreads();
+    }
+    std::string name = "basic_par_" + std::to_string(++parallelCount);
+
+    const Expr& cond = *loop.expr;
+    const std::string& var = cond.left->name;
+    size_t bodyEnd = loop.body.size() - 1;
+
+    std::set<std::string> assigned, read;
+    for (size_t i = 0; i < bodyEnd; i++)
+    {
+        assignedScalars(loop.body[i], assigned);
+        readScalars(loop.body[i], read);
+    }
+    std::set<std::string> reductions(loop.reductions.begin(), loop.reductions.end());
+
+    std::vector<std::string> shared, privates;
+    for (const std::string& v : read)
+    {
+        if (v != var && !assigned.count(v) && !reductions.count(v))
+        {
+            shared.push_back(v);
+        }
+    }
+    for (const std::string& v : assigned)
+    {
+        if (v != var && !reductions.count(v))
+        {
+            privates.push_back(v);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> combine; //name, operator
+    for (const std::string& r : loop.reductions)
+    {
+        std::string op;
+        for (size_t i = 0; op.empty() && i < bodyEnd; i++)
+        {
+            op = firstReductionOp(loop.body[i], r);
+        }
+        combine.push_back({r, op.empty() ? "+" : op});
+    }
+
+    emitter.addHeader("");
+    emitter.addHeader("struct " + name);
+    emitter.addHeader("{");
+    emitter.addHeader("    long long basic_begin, basic_end;");
+    emitter.addHeader("    int basic_started;");
+    for (const std::string& v : shared)
+    {
+        emitter.addHeader("    int " + cname(v) + ";");
+    }
+    for (const auto& r : combine)
+    {
+        emitter.addHeader("    int " + cname(r.first) + ";");
+    }
+    for (const std::string& v : privates)
+    {
+        emitter.addHeader("    int " + cname(v) + ";");
+    }
+    emitter.addHeader("};");
+
+    //caller: split the range, start the workers, run the first chunk itself
+    std::string end = "(long long)" + expression(*cond.right) + (cond.op == "<" ? "" : " + 1");
+    declare(var);
+    emitter.addLine("{");
+    emitter.addLine("struct " + name + " basic_ctx[BASIC_MAX_THREADS];");
+    emitter.addLine("pthread_t basic_tid[BASIC_MAX_THREADS];");
+    emitter.addLine("long long basic_begin = " + cname(var) + ", basic_end = " + end + ";");
+    emitter.addLine("if (basic_end > basic_begin) {");
+    emitter.addLine("int basic_n = basic_threads(basic_end - basic_begin);");
+    emitter.addLine("for (int basic_t = 0; basic_t < basic_n; basic_t++) {");
+    emitter.addLine("basic_ctx[basic_t].basic_begin = basic_begin + (basic_end - basic_begin) * basic_t / basic_n;");
+    emitter.addLine("basic_ctx[basic_t].basic_end = basic_begin + (basic_end - basic_begin) * (basic_t + 1) / basic_n;");
+    for (const std::string& v : shared)
+    {
+        declare(v);
+        emitter.addLine("basic_ctx[basic_t]." + cname(v) + " = " + cname(v) + ";");
+    }
+    emitter.addLine("basic_ctx[basic_t].basic_started = basic_t > 0 && pthread_create(&basic_tid[basic_t], NULL, " +
+                    name + ", &basic_ctx[basic_t]) == 0;");
+    emitter.addLine("}");
+    emitter.addLine(name + "(&basic_ctx[0]);");
+    emitter.addLine("for (int basic_t = 1; basic_t < basic_n; basic_t++) {");
+    emitter.addLine("if (basic_ctx[basic_t].basic_started) pthread_join(basic_tid[basic_t], NULL);");
+    emitter.addLine("else " + name + "(&basic_ctx[basic_t]);");
+    emitter.addLine("}");
+    if (!combine.empty())
+    {
+        emitter.addLine("for (int basic_t = 0; basic_t < basic_n; basic_t++) {");
+        for (const auto& r : combine)
+        {
+            declare(r.first);
+            std::string c = cname(r.first);
+            emitter.addLine(c + " = " + c + " " + r.second + " basic_ctx[basic_t]." + c + ";");
+        }
+        emitter.addLine("}");
+    }
+    for (const std::string& v : privates)
+    {
+        declare(v);
+        emitter.addLine(cname(v) + " = basic_ctx[basic_n - 1]." + cname(v) + ";");
+    }
+    emitter.addLine(cname(var) + " = (int)basic_end;");
+    emitter.addLine("}");
+    emitter.setPosition(loop.endLine, loop.endCol);
+    emitter.addLine("}");
+
+    //worker: one chunk of the loop over private copies
+    emitter.setPosition(loop.line, loop.col);
+    emitter.beginFunction("void* " + name + "(void* basic_arg)");
+    bool wasInRegion = inRegion;
+    inRegion = true;
+
+    emitter.addLine("struct " + name + "* basic_ctx = basic_arg;");
+    for (const std::string& v : shared)
+    {
+        emitter.addLine("int " + cname(v) + " = basic_ctx->" + cname(v) + ";");
+    }
+    for (const auto& r : combine)
+    {
+        emitter.addLine("int " + cname(r.first) + " = " + (r.second == "*" ? "1" : "0") + ";");
+    }
+    for (const std::string& v : privates)
+    {
+        emitter.addLine("int " + cname(v) + " = 0;");
+    }
+    emitter.addLine("int " + cname(var) + " = (int)basic_ctx->basic_begin;");
+    emitter.addLine("long long basic_last = basic_ctx->basic_end;");
+
+    std::set<std::string> arrays;
+    std::string guard = rangeGuard(loop, "basic_last", -1, arrays);
+    versionedLoop(loop, "for (; " + cname(var) + " < basic_last; " + cname(var) + "++) {", guard, arrays);
+
+    for (const auto& r : combine)
+    {
+        emitter.addLine("basic_ctx->" + cname(r.first) + " = " + cname(r.first) + ";");
+    }
+    for (const std::string& v : privates)
+    {
+        emitter.addLine("basic_ctx->" + cname(v) + " = " + cname(v) + ";");
+    }
+    emitter.addLine("return NULL;");
+
+    inRegion = wasInRegion;
+    emitter.endFunction();
+}
+
+//declare with the value left by the precomputed statements, if any
+void Generator::declare(const std::string& name)
+{
+    auto found = known->variables.find(name);
+    emitter.ensureVar(cname(name), found == known->variables.end() ? 0 : found->second);
+}
+
+//print the precomputed output with a single write
+void Generator::writeOutput(const std::string& output)
+{
+    if (output.empty())
+    {
+        return;
+    }
+
+    emitter.addLine(freestanding ? "basic_write(" : "fwrite(");
+    size_t start = 0;
+    while (start < output.size())
+    {
+        size_t end = output.find('\n', start);
+        end = end == std::string::npos ? output.size() : end + 1;
+        emitter.addLine("    \"" + quoteBytes(output.substr(start, end - start)) + "\"");
+        start = end;
+    }
+    emitter.addLine("    , " + std::string(freestanding ? "" : "1, ") + std::to_string(output.size()) +
+                    (freestanding ? ");" : ", stdout);"));
+}
+
+//C string literal body for arbitrary bytes
+std::string Generator::quoteBytes(const std::string& bytes)
+{
+    static const char DIGITS[] = "01234567";
+    std::string quoted;
+    for (char ch : bytes)
+    {
+        unsigned char c = (unsigned char)ch;
+        if (c == '\n')
+        {
+            quoted += "\\n";
+        }
+        else if (c == '\\' || c == '"' || c == '?')
+        {
+            quoted.push_back('\\');
+            quoted.push_back(ch);
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            quoted.push_back('\\');
+            quoted.push_back(DIGITS[(c >> 6) & 7]);
+            quoted.push_back(DIGITS[(c >> 3) & 7]);
+            quoted.push_back(DIGITS[c & 7]);
+        }
+        else
+        {
+            quoted.push_back(ch);
+        }
+    }
+    return quoted;
+}
+
+// Escape quotes and backslashes (the text is a %s argument, so % stays as is)
+std::string Generator::escapeString(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '\\')
+        {
+            escaped += "\\\\";
+        }
+        else if (c == '\"')
+        {
+            escaped += "\\\"";
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+void Generator::statement(const Stmt& stmt)
+{
+    emitter.setPosition(stmt.line, stmt.col);
+
+    switch (stmt.kind)
+    {
+    case Stmt::PRINT_STRING:
+        if (freestanding)
+        {
+            emitter.addLine("basic_print_str(\"" + escapeString(stmt.text) + "\");");
+            break;
+        }
+        emitter.addLine("printf(\"%s\\n\", \"" + escapeString(stmt.text) + "\");");
+        break;
+
+    case Stmt::PRINT_EXPR:
+        if (freestanding)
+        {
+            emitter.addLine("basic_print_int(" + expression(*stmt.expr) + ");");
+            break;
+        }
+        emitter.addLine("printf(\"%d\\n\", (" + expression(*stmt.expr) + "));");
+        break;
+
+    case Stmt::INPUT:
+    {
+        std::string target = cname(stmt.text);
+        if (stmt.index)
+        {
+            target = subscript(stmt.text, *stmt.index);
+        }
+        else
+        {
+            declare(stmt.text);
+        }
+        if (freestanding)
+        {
+            emitter.addLine("basic_input(&" + target + ");");
+            break;
+        }
+        emitter.addLine("{ if (scanf(\"%d\", &" + target +
+                        ") != 1) { fprintf(stderr, \"Input error\\n\"); exit(1); } }");
+        break;
+    }
+
+    case Stmt::LET:
+    {
+        std::string target = cname(stmt.text);
+        if (stmt.index)
+        {
+            target = subscript(stmt.text, *stmt.index);
+        }
+        else
+        {
+            declare(stmt.text);
+        }
+        std::string value = expression(*stmt.expr);
+        emitter.addLine(target + " = (" + value + ");");
+        break;
+    }
+
+    case Stmt::DIM:
+        //declared at file scope by declareArrays
+        break;
+
+    case Stmt::WHILE:
+        //no threads without libc, freestanding programs run it as a plain loop
+        if (stmt.parallel && !freestanding)
+        {
+            parallelLoop(stmt);
+            break;
+        }
+        if (isCountedLoop(stmt))
+        {
+            countedLoop(stmt);
+            break;
+        }
+        //fall through
+    case Stmt::IF:
+        emitter.addLine(std::string(stmt.kind == Stmt::IF ? "if" : "while") +
+                        " (" + expression(*stmt.expr) + ") {");
+        block(stmt.body);
+        emitter.setPosition(stmt.endLine, stmt.endCol);
+        emitter.addLine("}");
+        break;
+
+    case Stmt::LABEL:
+        emitter.addLine(stmt.text + ": ;");
+        break;
+
+    case Stmt::GOTO:
+        emitter.addLine("goto " + stmt.text + ";");
+        break;
+
+    case Stmt::SUB:
+    {
+        const SubPlan& plan = subs.at(stmt.text);
+        if (plan.inlined || plan.calls == 0)
+        {
+            break;
+        }
+        emitter.beginFunction("void " + subName(stmt.text) + "(void)");
+        block(stmt.body);
+        emitter.endFunction();
+        break;
+    }
+
+    case Stmt::CALL:
+    {
+        const SubPlan& plan = subs.at(stmt.text);
+        if (plan.inlined)
+        {
+            block(plan.sub->body);
+            break;
+        }
+        emitter.addLine(subName(stmt.text) + "();");
+        break;
+    }
+    }
+}
+
+std::string Generator::expression(const Expr& expr)
+{
+    switch (expr.kind)
+    {
+    case Expr::NUMBER:
+        return std::to_string(expr.value);
+
+    case Expr::VARIABLE:
+        declare(expr.name);
+        return cname(expr.name);
+
+    case Expr::UNARY:
+        return "(" + expr.op + expression(*expr.left) + ")";
+
+    case Expr::INDEX:
+        return subscript(expr.name, *expr.left);
+
+    case Expr::BINARY:
+    {
+        std::string left = expression(*expr.left);
+        std::string right = expression(*expr.right);
+        return "(" + left + " " + expr.op + " " + right + ")";
+    }
+    }
+    return "";
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+#include "emitter.h"
+#include "precompute.h"
+
+//turns a parsed program into C through the emitter
+class Generator
+{
+public:
+    explicit Generator(Emitter& emitterInstance);
+
+    void generate(const Program& program);
+
+    //same, with the leading statements already evaluated at compile time
+    void generate(const Program& program, const Precomputed& precomputed);
+
+    //split main() into helper functions of at most maxStatements statements
+    void setOutlining(size_t maxStatements);
+
+    //generate a program with its own runtime instead of libc (see runtime.h)
+    void setFreestanding(bool enabled);
+
+    //bundle of several programs in one C file: generate each member, then the
+    //main() that picks one by name
+    void generateMember(const std::string& name, const Program& program, const Precomputed& precomputed);
+    void generateDispatcher();
+
+    //one line per sub of the programs generated so far: inlined, out of line or
+    //dropped, and why
+    const std::vector<std::string>& inliningReport() const { return report; }
+
+private:
+    Emitter& emitter;
+    const Precomputed* known = nullptr;
+    size_t outlineSize = 0;     //0 = everything in main()
+    bool freestanding = false;
+    bool runtimeDeclared = false;
+    bool boundsDeclared = false;
+    std::vector<std::string> members;   //bundled program names
+    std::string prefix;                 //of C names in the current member
+
+    void declareRuntime();
+    std::string cname(const std::string& name) const;
+    bool inRegion = false;
+    int regionCount = 0;
+
+    void block(const std::vector<Stmt>& list, size_t first = 0, size_t stop = SIZE_MAX);
+    void region(const std::vector<Stmt>& list, size_t begin, size_t end);
+    static size_t statementSize(const Stmt& stmt);
+
+    //array sizes, and loop counters proven in range for some arrays
+    std::unordered_map<std::string, int> arraySizes;
+    std::vector<std::pair<std::string, std::set<std::string>>> checkedLoops;
+
+    void declareArrays(const Program& program);
+    void declareArray(const std::string& array);
+    void declareBoundsCheck();
+    static std::vector<std::reference_wrapper<const Stmt>> dims(const std::vector<Stmt>& list);
+    std::string subscript(const std::string& array, const Expr& index);
+
+    void countedLoop(const Stmt& loop);
+    std::string rangeGuard(const Stmt& loop, const std::string& end, int last, std::set<std::string>& arrays);
+    void versionedLoop(const Stmt& loop, const std::string& header, const std::string& guard,
+                       const std::set<std::string>& arrays);
+
+    //subs are inlined at every call when small or called once, and become
+    //void functions otherwise
+    struct SubPlan
+    {
+        const Stmt* sub;
+        size_t calls;   //call sites in the code that still runs
+        size_t size;    //statements, with the subs inlined into it
+        bool inlined;
+    };
+    std::unordered_map<std::string, SubPlan> subs;
+    std::vector<std::string> report;
+
+    void planSubs(const Program& program, size_t precomputed);
+    std::string subName(const std::string& name) const;
+
+    //parallel while, split into chunks run by worker threads
+    int parallelCount = 0;
+    void parallelLoop(const Stmt& loop);
+    void declareThreads();
+
+    void declare(const std::string& name);
+    void writeOutput(const std::string& output);
+
+    void statement(const Stmt& stmt);
+    std::string expression(const Expr& expr);
+
+    static std::string escapeString(const std::string& text);
+    static std::string quoteBytes(const std::string& bytes);
+};
@@ -0,0 +1,268 @@
+#include "incremental.h"
+#include "lexer.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+//full lex and parse of source.text
+static void reparseAll(ParsedSource& source)
+{
+    source.valid = false;
+
+    Lexer lexer(source.text);
+    source.tokens = lexer.tokenize();
+
+    Parser parser(source.tokens);
+    source.program = parser.parseProgram();
+    source.statementTokens = parser.statementStarts();
+    source.symbols = std::move(parser.symbolTable());
+
+    source.valid = true;
+}
+
+ParsedSource parseSource(const std::string& text)
+{
+    ParsedSource source;
+    source.text = text;
+    reparseAll(source);
+    return source;
+}
+
+//where the old and new token streams meet again after an edit: everything from
+//there on only moved by delta bytes and lineDelta lines, plus colDelta columns
+//for whatever is on syncLine (numbered as before the edit)
+struct Shift
+{
+    long long delta = 0;
+    int syncLine = 0;
+    int lineDelta = 0;
+    int colDelta = 0;
+
+    bool moves() const
+    {
+        return delta != 0 || lineDelta != 0 || colDelta != 0;
+    }
+
+    void apply(int& line, int& col) const
+    {
+        if (line <= 0)
+        {
+            return;
+        }
+        if (line == syncLine)
+        {
+            col += colDelta;
+        }
+        line += lineDelta;
+    }
+
+    void apply(Token& token) const
+    {
+        token.offset = (size_t)((long long)token.offset + delta);
+        apply(token.line, token.col);
+    }
+
+    void apply(Stmt& stmt) const
+    {
+        apply(stmt.line, stmt.col);
+        apply(stmt.endLine, stmt.endCol);
+        for (Stmt& inner : stmt.body)
+        {
+            apply(inner);
+        }
+    }
+};
+
+//replace list[begin, end) with replacement, moving rather than copying
+template <typename T>
+static void splice(std::vector<T>& list, size_t begin, size_t end, std::vector<T>& replacement)
+{
+    size_t common = std::min(end - begin, replacement.size());
+    std::move(replacement.begin(), replacement.begin() + common, list.begin() + begin);
+    if (replacement.size() > common)
+    {
+        list.insert(list.begin() + begin + common, std::make_move_iterator(replacement.begin() + common),
+                    std::make_move_iterator(replacement.end()));
+    }
+    else
+    {
+        list.erase(list.begin() + begin + common, list.begin() + end);
+    }
+}
+
+//names first used by top-level statements [first, stop), with their kind
+static std::vector<std::pair<std::string, Symbol::Kind>> namesIn(const SymbolTable& symbols, size_t first, size_t stop)
+{
+    std::vector<std::pair<std::string, Symbol::Kind>> names;
+    for (const auto& entry : symbols)
+    {
+        if (entry.second.statement >= first && entry.second.statement < stop)
+        {
+            names.push_back({entry.first, entry.second.kind});
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+void applyEdit(ParsedSource& source, const TextEdit& edit)
+{
+    if (edit.offset > source.text.size() || edit.removed > source.text.size() - edit.offset)
+    {
+        throw std::out_of_range("Edit outside the source text");
+    }
+
+    source.text.replace(edit.offset, edit.removed, edit.inserted);
+    if (!source.valid)
+    {
+        reparseAll(source);
+        return;
+    }
+    source.valid = false;
+
+    std::vector<Token>& tokens = source.tokens;
+    size_t oldEnd = edit.offset + edit.removed;
+    Shift shift;
+    shift.delta = (long long)edit.inserted.size() - (long long)edit.removed;
+
+    // ---------------------------------------------
+    // Relex
+    // ---------------------------------------------
+
+    //a token ending at or after the edit may grow into the new text, so start
+    //from the one before it (the lexer is back at a token boundary there)
+    size_t first = std::lower_bound(tokens.begin(), tokens.end(), edit.offset,
+                                    [](const Token& t, size_t offset) { return t.offset + t.length < offset; }) -
+                   tokens.begin();
+    size_t restart = first > 0 ? first - 1 : 0;
+
+    Lexer lexer(source.text);
+    if (first > 0)
+    {
+        lexer.seek(tokens[restart].offset, tokens[restart].line, tokens[restart].col);
+    }
+
+    //old tokens after the edit; once a new token starts exactly where one of them
+    //now is, the lexer is in the same state as before and the rest is unchanged
+    size_t sync = std::lower_bound(tokens.begin() + first, tokens.end(), oldEnd,
+                                   [](const Token& t, size_t offset) { return t.offset < offset; }) -
+                  tokens.begin();
+    std::vector<Token> fresh;
+    while (true)
+    {
+        Token t = lexer.nextToken();
+        while (sync < tokens.size() && (long long)tokens[sync].offset + shift.delta < (long long)t.offset)
+        {
+            sync++;
+        }
+        if (sync < tokens.size() && (long long)tokens[sync].offset + shift.delta == (long long)t.offset)
+        {
+            shift.syncLine = tokens[sync].line;
+            shift.lineDelta = t.line - tokens[sync].line;
+            shift.colDelta = t.col - tokens[sync].col;
+            break;
+        }
+        fresh.push_back(t);
+        if (t.type == "EOF")
+        {
+            sync = tokens.size();
+            break;
+        }
+    }
+
+    for (size_t i = sync; shift.moves() && i < tokens.size(); i++)
+    {
+        shift.apply(tokens[i]);
+    }
+    long long tokenDelta = (long long)fresh.size() - (long long)(sync - restart);
+    splice(tokens, restart, sync, fresh);
+
+    // ---------------------------------------------
+    // Reparse
+    // ---------------------------------------------
+
+    //statements are only damaged from the one holding the first relexed token up to
+    //the first one starting after the last; a statement cannot look past its own end
+    std::vector<size_t>& starts = source.statementTokens;
+    std::vector<Stmt>& statements = source.program.statements;
+    size_t count = statements.size();
+    size_t k = std::upper_bound(starts.begin(), starts.end(), restart) - starts.begin();
+    k = k > 0 ? k - 1 : 0;
+    size_t begin = k < count ? starts[k] : 0;
+    size_t stop = std::lower_bound(starts.begin(), starts.end(), sync) - starts.begin();
+
+    SymbolTable before;
+    for (const auto& entry : source.symbols)
+    {
+        if (entry.second.statement < k)
+        {
+            before.insert(entry);
+        }
+    }
+
+    Program parsed;
+    SymbolTable symbols;
+    std::vector<size_t> parsedStarts;
+    while (true)
+    {
+        //tokens up to the next reused statement, as a program of their own
+        size_t windowEnd = stop < count ? (size_t)((long long)starts[stop] + tokenDelta) : tokens.size() - 1;
+        std::vector<Token> window(tokens.begin() + begin, tokens.begin() + windowEnd);
+        Token eof = tokens[windowEnd];
+        eof.value = "";
+        eof.type = "EOF";
+        window.push_back(eof);
+
+        Parser parser(window);
+        parser.resume(before, k);
+        try
+        {
+            parsed = parser.parseProgram();
+        }
+        catch (const std::exception&)
+        {
+            //may just be cut off by the window (e.g. its endwhile was removed), so
+            //grow it until it reaches the real end of the source
+            if (stop >= count)
+            {
+                throw;
+            }
+            stop = std::min(count, stop + std::max<size_t>(1, stop - k));
+            continue;
+        }
+
+        //later statements were checked against the names declared before them
+        symbols = std::move(parser.symbolTable());
+        if (stop < count && namesIn(symbols, k, SIZE_MAX) != namesIn(source.symbols, k, stop))
+        {
+            stop = count;
+            continue;
+        }
+        parsedStarts = parser.statementStarts();
+        break;
+    }
+
+    long long statementDelta = (long long)parsed.statements.size() - (long long)(stop - k);
+    for (size_t i = stop; (shift.moves() || tokenDelta != 0) && i < count; i++)
+    {
+        shift.apply(statements[i]);
+        starts[i] = (size_t)((long long)starts[i] + tokenDelta);
+    }
+    for (size_t& start : parsedStarts)
+    {
+        start += begin;
+    }
+    splice(statements, k, stop, parsed.statements);
+    splice(starts, k, stop, parsedStarts);
+
+    for (const auto& entry : source.symbols)
+    {
+        if (entry.second.statement >= stop)
+        {
+            symbols[entry.first] = {entry.second.kind, (size_t)((long long)entry.second.statement + statementDelta)};
+        }
+    }
+    source.symbols = std::move(symbols);
+    source.valid = true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "parser.h"
+#include "token.h"
+
+//replace removed bytes at offset with inserted
+struct TextEdit
+{
+    size_t offset;
+    size_t removed;
+    std::string inserted;
+};
+
+//source text kept lexed and parsed across edits, for editor tooling
+struct ParsedSource
+{
+    std::string text;
+    std::vector<Token> tokens;              //ends with EOF
+    Program program;
+    std::vector<size_t> statementTokens;    //first token of each top-level statement
+    SymbolTable symbols;
+    bool valid = false;                     //false after an edit that did not lex/parse
+};
+
+//lex and parse text from scratch
+ParsedSource parseSource(const std::string& text);
+
+//apply edit to source.text, relexing only the tokens around it and reparsing only the
+//top-level statements those tokens belong to; the rest is reused with shifted positions.
+//Lexer/parser errors are rethrown with source.text already edited and source.valid false,
+//the next edit then starts from scratch
+void applyEdit(ParsedSource& source, const TextEdit& edit);
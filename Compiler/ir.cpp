@@ -0,0 +1,546 @@
+#include "ir.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ---------------------------------------------
+// Lowering from the AST
+// ---------------------------------------------
+namespace
+{
+class Lowering
+{
+public:
+    Module module;
+
+    //lower the first count statements of list
+    void statements(const std::vector<Stmt>& list, size_t count = SIZE_MAX)
+    {
+        for (size_t i = 0; i < count && i < list.size(); i++)
+        {
+            statement(list[i]);
+        }
+    }
+
+    //patch gotos once every label has an address
+    void resolveLabels()
+    {
+        for (const auto& fix : gotoFixups)
+        {
+            auto found = labels.find(fix.second);
+            if (found == labels.end())
+            {
+                throw std::runtime_error("goto to undefined label '" + fix.second + "'");
+            }
+            module.code[fix.first].arg = found->second;
+        }
+    }
+
+    size_t emit(Op op, int32_t arg = 0)
+    {
+        Instr instr = {};
+        instr.op = (uint8_t)op;
+        instr.arg = arg;
+        module.code.push_back(instr);
+        return module.code.size() - 1;
+    }
+
+private:
+    std::unordered_map<std::string, int32_t> varIndex;
+    std::unordered_map<std::string, int32_t> stringIndex;
+    std::unordered_map<std::string, int32_t> arrayIndex;
+    std::unordered_map<std::string, int32_t> labels;    //sub labels as sub.label
+    std::vector<std::pair<size_t, std::string>> gotoFixups;
+    std::unordered_map<std::string, int32_t> subs;      //first instruction of each body
+    std::string scope;                                  //"sub." while lowering one
+    uint32_t depth = 0;
+
+    int32_t variable(const std::string& name)
+    {
+        auto found = varIndex.find(name);
+        if (found != varIndex.end())
+        {
+            return found->second;
+        }
+        int32_t index = (int32_t)module.variables.size();
+        module.variables.push_back(name);
+        varIndex[name] = index;
+        return index;
+    }
+
+    int32_t string(const std::string& text)
+    {
+        auto found = stringIndex.find(text);
+        if (found != stringIndex.end())
+        {
+            return found->second;
+        }
+        int32_t index = (int32_t)module.strings.size();
+        module.strings.push_back(text);
+        stringIndex[text] = index;
+        return index;
+    }
+
+    int32_t here() const
+    {
+        return (int32_t)module.code.size();
+    }
+
+    void push()
+    {
+        depth++;
+        if (depth > module.maxStack)
+        {
+            module.maxStack = depth;
+        }
+    }
+
+    void statement(const Stmt& stmt)
+    {
+        switch (stmt.kind)
+        {
+        case Stmt::PRINT_STRING:
+            emit(Op::PRINT_STR, string(stmt.text));
+            break;
+
+        case Stmt::PRINT_EXPR:
+            expression(*stmt.expr);
+            emit(Op::PRINT_INT);
+            depth--;
+            break;
+
+        case Stmt::INPUT:
+            if (stmt.index)
+            {
+                expression(*stmt.index);
+                emit(Op::AINPUT, arrayIndex.at(stmt.text));
+                depth--;
+            }
+            else
+            {
+                emit(Op::INPUT, variable(stmt.text));
+            }
+            break;
+
+        case Stmt::LET:
+            if (stmt.index)
+            {
+                expression(*stmt.index);
+                expression(*stmt.expr);
+                emit(Op::ASTORE, arrayIndex.at(stmt.text));
+                depth -= 2;
+            }
+            else
+            {
+                int32_t target = variable(stmt.text);
+                expression(*stmt.expr);
+                emit(Op::STORE, target);
+                depth--;
+            }
+            break;
+
+        case Stmt::DIM:
+            arrayIndex[stmt.text] = (int32_t)module.arrays.size();
+            module.arrays.push_back({stmt.text, (uint32_t)stmt.size});
+            break;
+
+        case Stmt::IF:
+        {
+            expression(*stmt.expr);
+            size_t skip = emit(Op::JUMP_IF_FALSE);
+            depth--;
+            statements(stmt.body);
+            module.code[skip].arg = here();
+            break;
+        }
+
+        case Stmt::WHILE:
+        {
+            int32_t top = here();
+            expression(*stmt.expr);
+            size_t exit = emit(Op::JUMP_IF_FALSE);
+            depth--;
+            statements(stmt.body);
+            emit(Op::JUMP, top);
+            module.code[exit].arg = here();
+            break;
+        }
+
+        case Stmt::LABEL:
+            if (!labels.emplace(scope + stmt.text, here()).second)
+            {
+                throw std::runtime_error("duplicate label '" + stmt.text + "' at line " + std::to_string(stmt.line));
+            }
+            break;
+
+        case Stmt::GOTO:
+            gotoFixups.push_back({emit(Op::JUMP), scope + stmt.text});
+            break;
+
+        //the body is lowered in place, jumped over by the statements around it
+        case Stmt::SUB:
+        {
+            size_t skip = emit(Op::JUMP);
+            subs[stmt.text] = here();
+            scope = stmt.text + ".";
+            statements(stmt.body);
+            scope.clear();
+            emit(Op::RET);
+            module.code[skip].arg = here();
+            break;
+        }
+
+        case Stmt::CALL:
+        {
+            auto found = subs.find(stmt.text);
+            if (found == subs.end())
+            {
+                throw std::runtime_error("call to undefined sub '" + stmt.text + "'");
+            }
+            emit(Op::CALL, found->second);
+            break;
+        }
+        }
+    }
+
+    void expression(const Expr& expr)
+    {
+        switch (expr.kind)
+        {
+        case Expr::NUMBER:
+            emit(Op::CONST, expr.value);
+            push();
+            break;
+
+        case Expr::VARIABLE:
+            emit(Op::LOAD, variable(expr.name));
+            push();
+            break;
+
+        case Expr::UNARY:
+            expression(*expr.left);
+            emit(expr.op == "-" ? Op::NEG : Op::NOT);
+            break;
+
+        case Expr::INDEX:
+            expression(*expr.left);
+            emit(Op::ALOAD, arrayIndex.at(expr.name));
+            break;
+
+        case Expr::BINARY:
+        {
+            static const std::unordered_map<std::string, Op> BINARY_OPS = {
+                {"+", Op::ADD}, {"-", Op::SUB}, {"*", Op::MUL}, {"/", Op::DIV},
+                {"==", Op::EQ}, {"!=", Op::NE}, {"<", Op::LT}, {"<=", Op::LE},
+                {">", Op::GT}, {">=", Op::GE}
+            };
+            expression(*expr.left);
+            expression(*expr.right);
+            emit(BINARY_OPS.at(expr.op));
+            depth--;
+            break;
+        }
+        }
+    }
+};
+}
+
+Module lowerProgram(const Program& program)
+{
+    return lowerPrefix(program, program.statements.size());
+}
+
+Module lowerPrefix(const Program& program, size_t count)
+{
+    Lowering lowering;
+    lowering.statements(program.statements, count);
+    lowering.emit(Op::HALT);
+    lowering.resolveLabels();
+    return std::move(lowering.module);
+}
+
+// ---------------------------------------------
+// Serialization
+// ---------------------------------------------
+static void append(std::vector<char>& out, const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static void alignTo4(std::vector<char>& out)
+{
+    while (out.size() % 4 != 0)
+    {
+        out.push_back('\0');
+    }
+}
+
+std::vector<char> Module::serialize() const
+{
+    ModuleHeader header = {};
+    std::memcpy(header.magic, "BSIR", 4);
+    header.version = MODULE_VERSION;
+    header.byteOrder = MODULE_BYTE_ORDER;
+    header.maxStack = maxStack;
+
+    std::string pool;
+    std::vector<StringRef> varRefs, stringRefs;
+    std::vector<ArrayRef> arrayRefs;
+    for (const std::string& name : variables)
+    {
+        varRefs.push_back({(uint32_t)pool.size(), (uint32_t)name.size()});
+        pool += name;
+    }
+    for (const std::string& text : strings)
+    {
+        stringRefs.push_back({(uint32_t)pool.size(), (uint32_t)text.size()});
+        pool += text;
+    }
+    for (const auto& array : arrays)
+    {
+        arrayRefs.push_back({{(uint32_t)pool.size(), (uint32_t)array.first.size()}, array.second});
+        pool += array.first;
+    }
+
+    std::vector<char> out(sizeof(ModuleHeader));
+
+    header.varCount = (uint32_t)varRefs.size();
+    header.varsOffset = (uint32_t)out.size();
+    append(out, varRefs.data(), varRefs.size() * sizeof(StringRef));
+
+    header.stringCount = (uint32_t)stringRefs.size();
+    header.stringsOffset = (uint32_t)out.size();
+    append(out, stringRefs.data(), stringRefs.size() * sizeof(StringRef));
+
+    header.arrayCount = (uint32_t)arrayRefs.size();
+    header.arraysOffset = (uint32_t)out.size();
+    append(out, arrayRefs.data(), arrayRefs.size() * sizeof(ArrayRef));
+
+    header.codeCount = (uint32_t)code.size();
+    header.codeOffset = (uint32_t)out.size();
+    append(out, code.data(), code.size() * sizeof(Instr));
+
+    header.poolSize = (uint32_t)pool.size();
+    header.poolOffset = (uint32_t)out.size();
+    append(out, pool.data(), pool.size());
+    alignTo4(out);
+
+    std::memcpy(out.data(), &header, sizeof(header));
+    return out;
+}
+
+void writeModule(const Module& module, const std::string& path)
+{
+    std::vector<char> bytes = module.serialize();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("could not write " + path);
+    }
+    file.write(bytes.data(), (std::streamsize)bytes.size());
+    if (!file)
+    {
+        throw std::runtime_error("could not write " + path);
+    }
+}
+
+// ---------------------------------------------
+// Loading
+// ---------------------------------------------
+std::string ModuleView::variableName(uint32_t index) const
+{
+    return std::string(pool + vars[index].offset, vars[index].length);
+}
+
+std::string ModuleView::string(uint32_t index) const
+{
+    return std::string(pool + strings[index].offset, strings[index].length);
+}
+
+std::string ModuleView::arrayName(uint32_t index) const
+{
+    return std::string(pool + arrays[index].name.offset, arrays[index].name.length);
+}
+
+//true when [offset, offset + count * width) lies inside the file
+static bool inBounds(uint64_t offset, uint64_t count, uint64_t width, size_t size)
+{
+    return offset % 4 == 0 && offset + count * width <= size;
+}
+
+ModuleView parseModule(const char* data, size_t size)
+{
+    if (size < sizeof(ModuleHeader) || std::memcmp(data, "BSIR", 4) != 0)
+    {
+        throw std::runtime_error("not a compiled .basic program");
+    }
+
+    ModuleView view;
+    view.header = (const ModuleHeader*)data;
+    const ModuleHeader& h = *view.header;
+
+    if (h.byteOrder != MODULE_BYTE_ORDER)
+    {
+        throw std::runtime_error("program was compiled on a host with a different byte order");
+    }
+    if (h.version != MODULE_VERSION)
+    {
+        throw std::runtime_error("unsupported program format version " + std::to_string(h.version));
+    }
+    if (!inBounds(h.varsOffset, h.varCount, sizeof(StringRef), size) ||
+        !inBounds(h.stringsOffset, h.stringCount, sizeof(StringRef), size) ||
+        !inBounds(h.arraysOffset, h.arrayCount, sizeof(ArrayRef), size) ||
+        !inBounds(h.codeOffset, h.codeCount, sizeof(Instr), size) ||
+        !inBounds(h.poolOffset, h.poolSize, 1, size))
+    {
+        throw std::runtime_error("truncated program file");
+    }
+
+    view.vars = (const StringRef*)(data + h.varsOffset);
+    view.strings = (const StringRef*)(data + h.stringsOffset);
+    view.arrays = (const ArrayRef*)(data + h.arraysOffset);
+    view.code = (const Instr*)(data + h.codeOffset);
+    view.pool = data + h.poolOffset;
+
+    for (uint32_t i = 0; i < h.varCount + h.stringCount + h.arrayCount; i++)
+    {
+        const StringRef& ref = i < h.varCount ? view.vars[i] :
+                               i < h.varCount + h.stringCount ? view.strings[i - h.varCount] :
+                               view.arrays[i - h.varCount - h.stringCount].name;
+        if ((uint64_t)ref.offset + ref.length > h.poolSize)
+        {
+            throw std::runtime_error("string outside of the string pool");
+        }
+    }
+
+    if (h.codeCount == 0 || view.code[h.codeCount - 1].op != (uint8_t)Op::HALT)
+    {
+        throw std::runtime_error("program does not end in HALT");
+    }
+
+    //jumps only happen between statements, where the stack is empty
+    std::vector<bool> isTarget(h.codeCount, false);
+    for (uint32_t pc = 0; pc < h.codeCount; pc++)
+    {
+        const Instr& instr = view.code[pc];
+        Op op = (Op)instr.op;
+        if (instr.op >= (uint8_t)Op::OP_COUNT)
+        {
+            throw std::runtime_error("bad opcode at " + std::to_string(pc));
+        }
+        if ((op == Op::LOAD || op == Op::STORE || op == Op::INPUT) &&
+            (instr.arg < 0 || (uint32_t)instr.arg >= h.varCount))
+        {
+            throw std::runtime_error("bad variable index at " + std::to_string(pc));
+        }
+        if (op == Op::PRINT_STR && (instr.arg < 0 || (uint32_t)instr.arg >= h.stringCount))
+        {
+            throw std::runtime_error("bad string index at " + std::to_string(pc));
+        }
+        if ((op == Op::ALOAD || op == Op::ASTORE || op == Op::AINPUT) &&
+            (instr.arg < 0 || (uint32_t)instr.arg >= h.arrayCount))
+        {
+            throw std::runtime_error("bad array index at " + std::to_string(pc));
+        }
+        if (op == Op::JUMP || op == Op::JUMP_IF_FALSE || op == Op::CALL)
+        {
+            if (instr.arg < 0 || (uint32_t)instr.arg >= h.codeCount)
+            {
+                throw std::runtime_error("bad jump target at " + std::to_string(pc));
+            }
+            isTarget[instr.arg] = true;
+        }
+    }
+
+    uint32_t depth = 0;
+    for (uint32_t pc = 0; pc < h.codeCount; pc++)
+    {
+        if (isTarget[pc] && depth != 0)
+        {
+            throw std::runtime_error("jump into an expression at " + std::to_string(pc));
+        }
+
+        int pops = 0, pushes = 0;
+        switch ((Op)view.code[pc].op)
+        {
+        case Op::CONST: case Op::LOAD: pushes = 1; break;
+        case Op::STORE: case Op::PRINT_INT: case Op::JUMP_IF_FALSE: case Op::AINPUT: pops = 1; break;
+        case Op::NEG: case Op::NOT: case Op::ALOAD: pops = 1; pushes = 1; break;
+        case Op::ASTORE: pops = 2; break;
+        case Op::HALT: case Op::PRINT_STR: case Op::INPUT: case Op::JUMP: case Op::CALL: case Op::RET:
+        case Op::OP_COUNT: break;
+        default: pops = 2; pushes = 1; break;
+        }
+
+        if (depth < (uint32_t)pops)
+        {
+            throw std::runtime_error("stack underflow at " + std::to_string(pc));
+        }
+        depth = depth - pops + pushes;
+        if (depth > h.maxStack)
+        {
+            throw std::runtime_error("stack deeper than declared at " + std::to_string(pc));
+        }
+
+        Op op = (Op)view.code[pc].op;
+        if ((op == Op::JUMP || op == Op::JUMP_IF_FALSE || op == Op::HALT || op == Op::CALL || op == Op::RET) &&
+            depth != 0)
+        {
+            throw std::runtime_error("jump out of an expression at " + std::to_string(pc));
+        }
+    }
+
+    return view;
+}
+
+MappedModule::MappedModule(const std::string& path)
+    : base(nullptr), size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("could not open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("could not read " + path);
+    }
+    size = (size_t)st.st_size;
+
+    base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        base = nullptr;
+        throw std::runtime_error("could not map " + path);
+    }
+
+    try
+    {
+        moduleView = parseModule((const char*)base, size);
+    }
+    catch (...)
+    {
+        munmap(base, size);
+        throw;
+    }
+}
+
+MappedModule::~MappedModule()
+{
+    if (base != nullptr)
+    {
+        munmap(base, size);
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ast.h"
+
+//flat stack-machine form of a program, used for the .bin format
+//every expression leaves one value on the stack, statements leave it empty
+enum class Op : uint8_t
+{
+    HALT,
+    CONST,          //push arg
+    LOAD,           //push variable arg
+    STORE,          //pop into variable arg
+    NEG, NOT,
+    ADD, SUB, MUL, DIV,
+    EQ, NE, LT, LE, GT, GE,
+    PRINT_INT,      //pop and print
+    PRINT_STR,      //print string arg
+    INPUT,          //read into variable arg
+    ALOAD,          //pop index, push element of array arg
+    ASTORE,         //pop value, pop index, store into array arg
+    AINPUT,         //pop index, read into element of array arg
+    JUMP,           //continue at instruction arg
+    JUMP_IF_FALSE,  //pop, continue at instruction arg when zero
+    CALL,           //push the return address on the call stack, continue at instruction arg
+    RET,            //continue at the address popped from the call stack
+    OP_COUNT
+};
+
+struct Instr
+{
+    uint8_t op;
+    uint8_t pad[3];
+    int32_t arg;
+};
+
+//slice of the string pool
+struct StringRef
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+//array declared with dim
+struct ArrayRef
+{
+    StringRef name;
+    uint32_t size;
+};
+
+//.bin file header, every offset is from the start of the file so the
+//whole file can be mapped anywhere and used in place
+struct ModuleHeader
+{
+    char magic[4];          //"BSIR"
+    uint32_t version;
+    uint32_t byteOrder;     //MODULE_BYTE_ORDER as written by the producer
+    uint32_t maxStack;      //deepest evaluation stack the code needs
+    uint32_t varCount;      //variable names, StringRef each
+    uint32_t varsOffset;
+    uint32_t stringCount;   //PRINT_STR operands, StringRef each
+    uint32_t stringsOffset;
+    uint32_t arrayCount;    //ArrayRef each
+    uint32_t arraysOffset;
+    uint32_t codeCount;     //Instr each
+    uint32_t codeOffset;
+    uint32_t poolSize;      //bytes referenced by the StringRefs
+    uint32_t poolOffset;
+};
+
+const uint32_t MODULE_VERSION = 3;
+const uint32_t MODULE_BYTE_ORDER = 0x01020304;
+
+//program being built by the compiler
+struct Module
+{
+    std::vector<std::string> variables;
+    std::vector<std::string> strings;
+    std::vector<std::pair<std::string, uint32_t>> arrays; //name, size
+    std::vector<Instr> code;
+    uint32_t maxStack = 0;
+
+    //flatten into the .bin layout
+    std::vector<char> serialize() const;
+};
+
+//read-only, validated view of a serialized module
+struct ModuleView
+{
+    const ModuleHeader* header = nullptr;
+    const StringRef* vars = nullptr;
+    const StringRef* strings = nullptr;
+    const ArrayRef* arrays = nullptr;
+    const Instr* code = nullptr;
+    const char* pool = nullptr;
+
+    std::string variableName(uint32_t index) const;
+    std::string string(uint32_t index) const;
+    std::string arrayName(uint32_t index) const;
+};
+
+//compile the AST down to the flat form, resolving labels to instruction indexes
+Module lowerProgram(const Program& program);
+
+//same, for only the first count top-level statements
+Module lowerPrefix(const Program& program, size_t count);
+
+//check bounds, operands, jump targets and stack depth so the executor can trust the code
+ModuleView parseModule(const char* data, size_t size);
+
+void writeModule(const Module& module, const std::string& path);
+
+//a .bin file mapped read-only into memory
+class MappedModule
+{
+public:
+    explicit MappedModule(const std::string& path);
+    ~MappedModule();
+
+    MappedModule(const MappedModule&) = delete;
+    MappedModule& operator=(const MappedModule&) = delete;
+
+    const ModuleView& view() const { return moduleView; }
+
+private:
+    void* base;
+    size_t size;
+    ModuleView moduleView;
+};
@@ -6,7 +6,9 @@
 const std::unordered_map<std::string, std::string> Lexer::KEYWORDS = {
     {"print", "PRINT"}, {"if", "IF"}, {"then", "THEN"}, {"endif", "ENDIF"},
     {"let", "LET"}, {"input", "INPUT"}, {"while", "WHILE"}, {"repeat", "REPEAT"},
-    {"endwhile", "ENDWHILE"}, {"goto", "GOTO"}, {"label", "LABEL"}
+    {"endwhile", "ENDWHILE"}, {"goto", "GOTO"}, {"label", "LABEL"},
+    {"dim", "DIM"}, {"parallel", "PARALLEL"}, {"reduce", "REDUCE"},
+    {"sub", "SUB"}, {"endsub", "ENDSUB"}, {"call", "CALL"}
 };
 //define two character tokens
 const std::unordered_map<std::string, std::string> Lexer::TWO_CHAR = {
@@ -17,7 +19,8 @@ const std::unordered_map<std::string, std::string> Lexer::TWO_CHAR = {
 const std::unordered_map<char, std::string> Lexer::ONE_CHAR = {
     {'=', "ASSIGN"}, {'<', "COMP"}, {'>', "COMP"}, {'!', "NOT"},
     {'+', "PLUS"}, {'-', "MINUS"}, {'*', "TIMES"}, {'/', "DIVIDE"},
-    {';', "SEMICOLON"}, {'(', "LPAREN"}, {')', "RPAREN"}
+    {';', "SEMICOLON"}, {'(', "LPAREN"}, {')', "RPAREN"},
+    {'[', "LBRACKET"}, {']', "RBRACKET"}, {',', "COMMA"}
 };
 
 //constructor
@@ -97,8 +100,29 @@ bool Lexer::isIdentifier(char c) {
 
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
+    do {
+        tokens.push_back(nextToken());
+    } while (tokens.back().type != "EOF");
+    return tokens;
+}
+
+void Lexer::seek(size_t offset, int startLine, int startCol)
+{
+    i = offset;
+    line = startLine;
+    col = startCol;
+}
+
+//token from start up to the current position
+Token Lexer::make(const std::string& value, const std::string& type, size_t start, int startLine, int startCol) const
+{
+    return {value, type, startLine, startCol, start, i - start};
+}
+
+Token Lexer::nextToken() {
     while (!atEnd()) {
         char currentChar = look();
+        size_t start = i;
         
         //skip whitespace
         if (std::isspace(currentChar))
@@ -151,24 +175,25 @@ std::vector<Token> Lexer::tokenize() {
                 throw std::runtime_error("Unterminated string at line " + std::to_string(start_line));
             }
             advance(); // closing "
-            tokens.push_back({value, "STRING", start_line, start_col});
-            continue;
+            return make(value, "STRING", start, start_line, start_col);
         }
 
         //two-char operators
         std::string two = {currentChar, lookNext()};
         if (TWO_CHAR.count(two)) {
-            tokens.push_back({two, TWO_CHAR.at(two), line, col});
+            int start_line = line;
+            int start_col = col;
             advance();
             advance();
-            continue;
+            return make(two, TWO_CHAR.at(two), start, start_line, start_col);
         }
 
         //one-char operators
         if (ONE_CHAR.count(currentChar)) {
-            tokens.push_back({std::string(1, currentChar), ONE_CHAR.at(currentChar), line, col});
+            int start_line = line;
+            int start_col = col;
             advance();
-            continue;
+            return make(std::string(1, currentChar), ONE_CHAR.at(currentChar), start, start_line, start_col);
         }
 
         //nums
@@ -180,8 +205,7 @@ std::vector<Token> Lexer::tokenize() {
             {
                 num.push_back(advance());
             }
-            tokens.push_back({num, "INTEGER", start_line, start_col});
-            continue;
+            return make(num, "INTEGER", start, start_line, start_col);
         }
 
         //keywords/identifiers
@@ -202,18 +226,13 @@ std::vector<Token> Lexer::tokenize() {
 
             if (KEYWORDS.count(lower))
             {
-                tokens.push_back({lower, KEYWORDS.at(lower), start_line, start_col});
-            }
-            else
-            {
-                tokens.push_back({id, "IDENT", start_line, start_col});
+                return make(lower, KEYWORDS.at(lower), start, start_line, start_col);
             }
-            continue;
+            return make(id, "IDENT", start, start_line, start_col);
         }
 
         throw std::runtime_error("Unknown character '" + std::string(1, currentChar) + "' at line " + std::to_string(line));
     }
 
-    tokens.push_back({"", "EOF", line, col});
-    return tokens;
+    return make("", "EOF", i, line, col);
 }
\ No newline at end of file
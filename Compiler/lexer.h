@@ -11,8 +11,14 @@ public:
     //function to create tokens
     std::vector<Token> tokenize(); 
 
+    //one token at a time, type EOF once the source is used up
+    Token nextToken();
+
+    //continue from a token boundary of an earlier run over the same text
+    void seek(size_t offset, int line, int col);
+
 private:
-    std::string src;
+    const std::string& src; //not copied, must outlive the lexer
     size_t i; //index in src
     int line; //position in src
     int col;
@@ -22,6 +28,7 @@ private:
     char look() const;
     char lookNext() const;
     char advance();
+    Token make(const std::string& value, const std::string& type, size_t start, int startLine, int startCol) const;
 
     static bool isIdentifierStart(char c);
     static bool isIdentifier(char c);
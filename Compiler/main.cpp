@@ -1,11 +1,22 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "lexer.h"
 #include "parser.h"
 #include "emitter.h"
+#include "generator.h"
+#include "ir.h"
+#include "executor.h"
+#include "precompute.h"
+#include "watch.h"
+#include "runtime.h"
+#include "pipeline.h"
 
 //helper func to see if ends with given suffix
 bool hasSuffix(const std::string& str, const std::string& suffix)
@@ -18,20 +29,35 @@ bool hasSuffix(const std::string& str, const std::string& suffix)
     return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
 }
 
-int main(int argc, char** argv)
+//settings shared by every file the driver compiles
+struct CompileOptions
+{
+    bool lineDirectives = false;    //-g
+    bool emitBinary = false;        //--emit-bin
+    bool precompute = false;        //--precompute
+    uint64_t stepBudget = 1000000;  //--step-budget, loop iterations/gotos
+    size_t outlineSize = 0;         //--outline, statements per helper function
+    bool freestanding = false;      //--freestanding
+    bool inlineReport = false;      //--inline-report
+    bool pipeline = false;          //--pipeline
+};
+
+//what the generator did with each sub, on stderr like a compiler remark
+static void printInliningReport(const std::string& inputPath, const std::vector<std::string>& report, size_t first)
 {
-    if (argc != 2)
+    for (size_t i = first; i < report.size(); i++)
     {
-        std::cerr << "Usage: " << argv[0] << " <file.basic>" << std::endl;
-        return 1;
+        std::cerr << inputPath << ": " << report[i] << std::endl;
     }
+}
 
-    std::string inputPath = argv[1];
-
+//read and parse one .basic file, errors go to stderr
+static bool loadProgram(const std::string& inputPath, Program& program, const CompileOptions& options)
+{
     if (!hasSuffix(inputPath, ".basic"))
     {
         std::cerr << "Error: Input file must have a .basic extension." << std::endl;
-        return 1;
+        return false;
     }
 
     //read into string
@@ -40,7 +66,7 @@ int main(int argc, char** argv)
     if (!inputFile.is_open())
     {
         std::cerr << "Error: Could not open input file: " << inputPath << std::endl;
-        return 1;
+        return false;
     }
 
     std::string sourceCode(
@@ -53,13 +79,66 @@ int main(int argc, char** argv)
     //run the other files i made
     try
     {
+        if (options.pipeline)
+        {
+            program = parsePipelined(sourceCode);
+            return true;
+        }
+
         Lexer lexer(sourceCode);
         std::vector<Token> tokens = lexer.tokenize();
 
-        Emitter emitter;
-        Parser parser(tokens, emitter);
+        Parser parser(tokens);
+        program = parser.parseProgram();
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Compilation error: " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+//transpile one .basic file to <file>.basic.c, or <file>.basic.bin with emitBinary
+static bool compileFile(const std::string& inputPath, const CompileOptions& options)
+{
+    Program program;
+    if (!loadProgram(inputPath, program, options))
+    {
+        return false;
+    }
 
-        parser.parseProgram();
+    try
+    {
+        //serialize for --run instead of going through C
+        if (options.emitBinary)
+        {
+            std::string outputPath = inputPath + ".bin";
+            writeModule(lowerProgram(program), outputPath);
+            std::cout << "Successfully compiled to: " << outputPath << std::endl;
+            return true;
+        }
+
+        Emitter emitter;
+        if (options.lineDirectives)
+        {
+            emitter.enableLineDirectives(inputPath, inputPath + ".c");
+        }
+        Generator generator(emitter);
+        generator.setOutlining(options.outlineSize);
+        generator.setFreestanding(options.freestanding);
+        if (options.precompute)
+        {
+            generator.generate(program, precomputeProgram(program, options.stepBudget));
+        }
+        else
+        {
+            generator.generate(program);
+        }
+        if (options.inlineReport)
+        {
+            printInliningReport(inputPath, generator.inliningReport(), 0);
+        }
 
         //transpile into c
         std::string outputPath = inputPath + ".c";
@@ -69,18 +148,210 @@ int main(int argc, char** argv)
         if (!outputFile.is_open())
         {
             std::cerr << "Error: Could not write to output file: " << outputPath << std::endl;
-            return 1;
+            return false;
         }
 
         outputFile << emitter.getCode();
         outputFile.close();
 
         std::cout << "Successfully transpiled to: " << outputPath << std::endl;
-        return 0;
+        return true;
     }
     catch (const std::exception& ex)
     {
         std::cerr << "Compilation error: " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+//transpile several .basic files into one C file, each program runs when the
+//binary is invoked under its name (file name without .basic) or given it as argv[1]
+static bool compileBundle(const std::vector<std::string>& inputPaths, const std::string& outputPath,
+                          const CompileOptions& options)
+{
+    try
+    {
+        Emitter emitter;
+        Generator generator(emitter);
+        generator.setOutlining(options.outlineSize);
+        generator.setFreestanding(options.freestanding);
+
+        std::set<std::string> names;
+        for (const std::string& inputPath : inputPaths)
+        {
+            Program program;
+            if (!loadProgram(inputPath, program, options))
+            {
+                return false;
+            }
+
+            std::string name = inputPath.substr(inputPath.find_last_of('/') + 1);
+            name = name.substr(0, name.length() - 6);
+            if (!names.insert(name).second)
+            {
+                std::cerr << "Error: Two programs named " << name << " in the bundle" << std::endl;
+                return false;
+            }
+
+            if (options.lineDirectives)
+            {
+                emitter.enableLineDirectives(inputPath, outputPath);
+            }
+            size_t reported = generator.inliningReport().size();
+            generator.generateMember(name, program,
+                                     options.precompute ? precomputeProgram(program, options.stepBudget) : Precomputed());
+            if (options.inlineReport)
+            {
+                printInliningReport(inputPath, generator.inliningReport(), reported);
+            }
+        }
+        generator.generateDispatcher();
+
+        std::ofstream outputFile(outputPath);
+        if (!outputFile.is_open())
+        {
+            std::cerr << "Error: Could not write to output file: " << outputPath << std::endl;
+            return false;
+        }
+        outputFile << emitter.getCode();
+        outputFile.close();
+
+        std::cout << "Successfully bundled " << inputPaths.size() << " programs to: " << outputPath << std::endl;
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Compilation error: " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> inputPaths;
+    std::string bundlePath;
+    std::string watchDir;
+    std::string runPath;
+    CompileOptions options;
+    bool build = false;
+    bool usageError = false;
+
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+
+        //-g maps the generated C back to the .basic file for gdb/perf/gcov
+        if (arg == "-g" || arg == "--line-directives")
+        {
+            options.lineDirectives = true;
+        }
+        else if (arg == "--watch" && a + 1 < argc)
+        {
+            watchDir = argv[++a];
+        }
+        else if (arg == "--build")
+        {
+            build = true;
+        }
+        else if (arg == "--emit-bin")
+        {
+            options.emitBinary = true;
+        }
+        //evaluate input-independent code at compile time
+        else if (arg == "--precompute")
+        {
+            options.precompute = true;
+        }
+        else if (arg == "--step-budget" && a + 1 < argc)
+        {
+            options.stepBudget = std::strtoull(argv[++a], nullptr, 10);
+        }
+        //keep gcc's per-function optimizer cost bounded on huge programs
+        else if (arg == "--outline" && a + 1 < argc)
+        {
+            options.outlineSize = std::strtoul(argv[++a], nullptr, 10);
+        }
+        //own _start and raw syscalls, no libc startup cost per exec
+        else if (arg == "--freestanding")
+        {
+            options.freestanding = true;
+        }
+        //many programs, one binary
+        else if (arg == "--bundle" && a + 1 < argc)
+        {
+            bundlePath = argv[++a];
+        }
+        //which subs were inlined and why
+        else if (arg == "--inline-report")
+        {
+            options.inlineReport = true;
+        }
+        //lex on a second thread while parsing, for very large sources
+        else if (arg == "--pipeline")
+        {
+            options.pipeline = true;
+        }
+        else if (arg == "--run" && a + 1 < argc)
+        {
+            runPath = argv[++a];
+        }
+        else if (arg[0] != '-')
+        {
+            inputPaths.push_back(arg);
+        }
+        else
+        {
+            usageError = true;
+        }
+    }
+
+    int modes = !inputPaths.empty() + !watchDir.empty() + !runPath.empty();
+    usageError = usageError || (bundlePath.empty() ? inputPaths.size() > 1 : inputPaths.empty() || options.emitBinary);
+    if (usageError || modes != 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " [options] <file.basic>" << std::endl;
+        std::cerr << "       " << argv[0] << " [options] --watch <dir> [--build]" << std::endl;
+        std::cerr << "       " << argv[0] << " [options] --bundle <out.c> <file.basic>..." << std::endl;
+        std::cerr << "       " << argv[0] << " --run <file.basic.bin>" << std::endl;
+        std::cerr << "Options: -g, --emit-bin, --precompute [--step-budget N], --outline N, --freestanding," << std::endl;
+        std::cerr << "         --inline-report, --pipeline" << std::endl;
         return 1;
     }
+
+    //execute a compiled program straight from the mapped file
+    if (!runPath.empty())
+    {
+        try
+        {
+            MappedModule module(runPath);
+            int status = execute(module.view(), stdin, stdout);
+            std::fflush(stdout);
+            return status;
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "Runtime error: " << ex.what() << std::endl;
+            return 1;
+        }
+    }
+
+    //stay resident and re-transpile whatever changes
+    if (!watchDir.empty())
+    {
+        std::vector<std::string> gccFlags = {"-pthread"};
+        if (options.freestanding)
+        {
+            gccFlags = freestandingFlags();
+        }
+        return watchDirectory(watchDir, [&](const std::string& path) {
+            return compileFile(path, options);
+        }, build && !options.emitBinary, gccFlags);
+    }
+
+    if (!bundlePath.empty())
+    {
+        return compileBundle(inputPaths, bundlePath, options) ? 0 : 1;
+    }
+
+    return compileFile(inputPaths[0], options) ? 0 : 1;
 }
@@ -1,26 +1,35 @@
 #include "parser.h"
+#include "analysis.h"
+#include <algorithm>
+#include <set>
 #include <stdexcept>
 #include <iostream>
 
 // ---------------------------------------------
 // Constructor
 // ---------------------------------------------
-Parser::Parser(const std::vector<Token>& tokenList, Emitter& emitterInstance)
-    : tokens(tokenList), currentIndex(0), emitter(emitterInstance)
+Parser::Parser(const std::vector<Token>& tokenList)
+    : list(&tokenList), currentIndex(0)
 {
 }
 
+Parser::Parser(std::function<Token()> next)
+    : currentIndex(0), pull(std::move(next))
+{
+    pulled.push_back(pull());
+}
+
 // ---------------------------------------------
 // Utility helper functions
 // ---------------------------------------------
 const Token& Parser::currentToken() const
 {
-    return tokens[currentIndex];
+    return tokenAt(currentIndex);
 }
 
 const Token& Parser::previousToken() const
 {
-    return tokens[currentIndex - 1];
+    return tokenAt(currentIndex - 1);
 }
 
 bool Parser::checkType(const std::string& type) const
@@ -35,8 +44,13 @@ bool Parser::checkValue(const std::string& value) const
 
 void Parser::advance()
 {
-    if (currentIndex < tokens.size() - 1)
+    if (currentIndex < tokenCount() - 1)
+    {
+        currentIndex++;
+    }
+    else if (pull && pulled.back().type != "EOF")
     {
+        pulled.push_back(pull());
         currentIndex++;
     }
 }
@@ -52,7 +66,11 @@ void Parser::expectType(const std::string& type, const std::string& context)
 
 void Parser::error(const std::string& message) const
 {
-    const Token& t = currentToken();
+    errorAt(currentToken(), message);
+}
+
+void Parser::errorAt(const Token& t, const std::string& message) const
+{
     throw std::runtime_error(
         "Parser error at line " + std::to_string(t.line) + ", column " + std::to_string(t.col) +
         ": " + message
@@ -62,22 +80,85 @@ void Parser::error(const std::string& message) const
 // ---------------------------------------------
 // Main parsing entry point
 // ---------------------------------------------
-void Parser::parseProgram()
+Program Parser::parseProgram()
 {
-    emitter.addHeader("#include <stdio.h>");
-    emitter.addHeader("#include <stdlib.h>");
+    Program program;
 
     while (!checkType("EOF"))
     {
-        statement();
+        starts.push_back(currentIndex);
+        program.statements.push_back(checkType("SUB") ? subroutine() : statement());
+        statementIndex++;
     }
+
+    return program;
+}
+
+void Parser::resume(SymbolTable symbolTable, size_t firstStatement)
+{
+    symbols = std::move(symbolTable);
+    statementIndex = firstStatement;
+}
+
+// ---------------------------------------------
+// Grammar rule: sub name ... endsub
+// ---------------------------------------------
+Stmt Parser::subroutine()
+{
+    Stmt stmt;
+    stmt.kind = Stmt::SUB;
+    stmt.line = currentToken().line;
+    stmt.col = currentToken().col;
+    advance();
+
+    if (!checkType("IDENT"))
+    {
+        error("Expected sub name after 'sub'");
+    }
+    //declared before the body, so a sub can call itself
+    declare(currentToken(), Symbol::SUB);
+    stmt.text = currentToken().value;
+    advance();
+
+    while (!checkType("ENDSUB"))
+    {
+        if (checkType("EOF"))
+        {
+            error("Unclosed 'sub'");
+        }
+        stmt.body.push_back(statement());
+    }
+
+    stmt.endLine = currentToken().line;
+    stmt.endCol = currentToken().col;
+    advance(); // consume ENDSUB
+
+    //a sub is its own function, gotos cannot leave it
+    std::vector<const Stmt*> labels, gotos;
+    collect(stmt, Stmt::LABEL, labels);
+    collect(stmt, Stmt::GOTO, gotos);
+    for (const Stmt* jump : gotos)
+    {
+        bool found = std::any_of(labels.begin(), labels.end(),
+                                 [&](const Stmt* label) { return label->text == jump->text; });
+        if (!found)
+        {
+            errorAt({"", "", jump->line, jump->col},
+                    "goto " + jump->text + " leaves sub '" + stmt.text + "', label not found in it");
+        }
+    }
+    return stmt;
 }
 
 // ---------------------------------------------
 // Grammar rule: statement
 // ---------------------------------------------
-void Parser::statement()
+Stmt Parser::statement()
 {
+    Stmt stmt;
+    stmt.line = currentToken().line;
+    stmt.col = currentToken().col;
+
     // print "string";
     if (checkType("PRINT"))
     {
@@ -85,45 +166,18 @@ void Parser::statement()
 
         if (checkType("STRING"))
         {
-            std::string text = currentToken().value;
+            stmt.kind = Stmt::PRINT_STRING;
+            stmt.text = currentToken().value;
             advance();
-
-            // Escape quotes and percent symbols
-            std::string escaped;
-            for (char c : text)
-            {
-                if (c == '%')
-                {
-                    escaped += "%%";
-                }
-                else if (c == '\\')
-                {
-                    escaped += "\\\\";
-                }
-                else if (c == '\"')
-                {
-                    escaped += "\\\"";
-                }
-                else if (c == '\n')
-                {
-                    escaped += "\\n";
-                }
-                else
-                {
-                    escaped.push_back(c);
-                }
-            }
-
-            emitter.addLine("printf(\"%s\\n\", \"" + escaped + "\");");
         }
         else
         {
-            std::string expr = comparison();
-            emitter.addLine("printf(\"%d\\n\", (" + expr + "));");
+            stmt.kind = Stmt::PRINT_EXPR;
+            stmt.expr = comparison();
         }
 
         expectType("SEMICOLON", "after print statement");
-        return;
+        return stmt;
     }
 
     // input variable;
@@ -131,20 +185,11 @@ void Parser::statement()
     {
         advance();
 
-        if (!checkType("IDENT"))
-        {
-            error("Expected identifier after 'input'");
-        }
-
-        std::string name = currentToken().value;
-        emitter.ensureVar(name);
-        advance();
-
-        emitter.addLine("{ if (scanf(\"%d\", &" + name +
-                        ") != 1) { fprintf(stderr, \"Input error\\n\"); exit(1); } }");
+        stmt.kind = Stmt::INPUT;
+        target(stmt, "Expected identifier after 'input'");
 
         expectType("SEMICOLON", "after input statement");
-        return;
+        return stmt;
     }
 
     // let variable = expression;
@@ -152,30 +197,23 @@ void Parser::statement()
     {
         advance();
 
-        if (!checkType("IDENT"))
-        {
-            error("Expected identifier after 'let'");
-        }
-
-        std::string name = currentToken().value;
-        emitter.ensureVar(name);
-        advance();
+        stmt.kind = Stmt::LET;
+        target(stmt, "Expected identifier after 'let'");
 
         expectType("ASSIGN", "assignment");
-        std::string expr = comparison();
+        stmt.expr = comparison();
 
-        emitter.addLine(name + " = (" + expr + ");");
         expectType("SEMICOLON", "after assignment");
-        return;
+        return stmt;
     }
 
     // if comparison then ... endif
     if (checkType("IF"))
     {
         advance();
-        std::string condition = comparison();
+        stmt.kind = Stmt::IF;
+        stmt.expr = comparison();
         expectType("THEN", "after if condition");
-        emitter.addLine("if (" + condition + ") {");
 
         while (!checkType("ENDIF"))
         {
@@ -183,21 +221,48 @@ void Parser::statement()
             {
                 error("Unclosed 'if' statement");
             }
-            statement();
+            stmt.body.push_back(statement());
         }
 
+        stmt.endLine = currentToken().line;
+        stmt.endCol = currentToken().col;
         advance(); // consume ENDIF
-        emitter.addLine("}");
-        return;
+        return stmt;
+    }
+
+    // [parallel] while comparison [reduce name, ...] repeat ... endwhile
+    if (checkType("PARALLEL"))
+    {
+        advance();
+        if (!checkType("WHILE"))
+        {
+            error("Expected 'while' after 'parallel'");
+        }
+        stmt.parallel = true;
     }
 
-    // while comparison repeat ... endwhile
     if (checkType("WHILE"))
     {
         advance();
-        std::string condition = comparison();
+        stmt.kind = Stmt::WHILE;
+        stmt.expr = comparison();
+
+        if (stmt.parallel && checkType("REDUCE"))
+        {
+            do
+            {
+                advance();
+                if (!checkType("IDENT"))
+                {
+                    error("Expected variable name after 'reduce'");
+                }
+                useScalar(currentToken());
+                stmt.reductions.push_back(currentToken().value);
+                advance();
+            } while (checkType("COMMA"));
+        }
+
         expectType("REPEAT", "after while condition");
-        emitter.addLine("while (" + condition + ") {");
 
         while (!checkType("ENDWHILE"))
         {
@@ -205,12 +270,18 @@ void Parser::statement()
             {
                 error("Unclosed 'while' loop");
             }
-            statement();
+            stmt.body.push_back(statement());
         }
 
+        stmt.endLine = currentToken().line;
+        stmt.endCol = currentToken().col;
         advance(); // consume ENDWHILE
-        emitter.addLine("}");
-        return;
+
+        if (stmt.parallel)
+        {
+            checkParallel(stmt);
+        }
+        return stmt;
     }
 
     // label name;
@@ -223,12 +294,12 @@ void Parser::statement()
             error("Expected label name");
         }
 
-        std::string label = currentToken().value;
+        stmt.kind = Stmt::LABEL;
+        stmt.text = currentToken().value;
         advance();
 
-        emitter.addLine(label + ": ;");
         expectType("SEMICOLON", "after label");
-        return;
+        return stmt;
     }
 
     // goto name;
@@ -241,67 +312,403 @@ void Parser::statement()
             error("Expected label name after 'goto'");
         }
 
-        std::string label = currentToken().value;
+        stmt.kind = Stmt::GOTO;
+        stmt.text = currentToken().value;
         advance();
 
-        emitter.addLine("goto " + label + ";");
         expectType("SEMICOLON", "after goto");
-        return;
+        return stmt;
+    }
+
+    // dim name[size];
+    if (checkType("DIM"))
+    {
+        advance();
+
+        if (!checkType("IDENT"))
+        {
+            error("Expected array name after 'dim'");
+        }
+
+        std::string name = currentToken().value;
+        declare(currentToken(), Symbol::ARRAY);
+        advance();
+
+        expectType("LBRACKET", "array size");
+        if (!checkType("INTEGER") || currentToken().value.find_first_not_of('0') == std::string::npos)
+        {
+            error("Array size must be a positive integer");
+        }
+        stmt.size = primary()->value;
+        expectType("RBRACKET", "array size");
+
+        stmt.kind = Stmt::DIM;
+        stmt.text = name;
+
+        expectType("SEMICOLON", "after dim");
+        return stmt;
+    }
+
+    // call name;
+    if (checkType("CALL"))
+    {
+        advance();
+
+        if (!checkType("IDENT"))
+        {
+            error("Expected sub name after 'call'");
+        }
+
+        auto found = symbols.find(currentToken().value);
+        if (found == symbols.end() || found->second.kind != Symbol::SUB)
+        {
+            error("Sub '" + currentToken().value + "' called before it is defined");
+        }
+
+        stmt.kind = Stmt::CALL;
+        stmt.text = currentToken().value;
+        advance();
+
+        expectType("SEMICOLON", "after call");
+        return stmt;
+    }
+
+    if (checkType("SUB"))
+    {
+        error("'sub' is only allowed at the top level");
     }
 
     // Unknown statement
     error("Unexpected token: " + currentToken().type);
+    return stmt;
+}
+
+// name or name[index] being assigned by input/let
+void Parser::target(Stmt& stmt, const std::string& context)
+{
+    if (!checkType("IDENT"))
+    {
+        error(context);
+    }
+
+    const Token& name = currentToken();
+    stmt.text = name.value;
+    advance();
+
+    if (checkType("LBRACKET"))
+    {
+        useArray(name);
+        advance();
+        stmt.index = comparison();
+        expectType("RBRACKET", "array subscript");
+    }
+    else
+    {
+        useScalar(name);
+    }
+}
+
+// ---------------------------------------------
+// Parallel loop checks
+// ---------------------------------------------
+
+//every array access in stmt with its subscript
+static void arrayAccesses(const Expr* expr, std::vector<std::pair<std::string, const Expr*>>& found)
+{
+    if (expr == nullptr)
+    {
+        return;
+    }
+    if (expr->kind == Expr::INDEX)
+    {
+        found.push_back({expr->name, expr->left.get()});
+    }
+    arrayAccesses(expr->left.get(), found);
+    arrayAccesses(expr->right.get(), found);
+}
+
+static void arrayAccesses(const Stmt& stmt, std::vector<std::pair<std::string, const Expr*>>& found)
+{
+    if (stmt.index)
+    {
+        found.push_back({stmt.text, stmt.index.get()});
+    }
+    arrayAccesses(stmt.index.get(), found);
+    arrayAccesses(stmt.expr.get(), found);
+    for (const Stmt& inner : stmt.body)
+    {
+        arrayAccesses(inner, found);
+    }
+}
+
+//arrays assigned by stmt (or anything in it)
+static void writtenArrays(const Stmt& stmt, std::set<std::string>& names)
+{
+    if (stmt.kind == Stmt::LET && stmt.index)
+    {
+        names.insert(stmt.text);
+    }
+    for (const Stmt& inner : stmt.body)
+    {
+        writtenArrays(inner, names);
+    }
+}
+
+//iterations of a parallel loop run on several threads, so only accept loops
+//whose iterations cannot affect each other
+void Parser::checkParallel(const Stmt& loop) const
+{
+    auto fail = [&](const Stmt& at, const std::string& message) {
+        errorAt({"", "", at.line, at.col}, message);
+    };
+
+    //a sub may touch anything, and would not be a counted loop anyway
+    std::vector<const Stmt*> calls;
+    collect(loop, Stmt::CALL, calls);
+    if (!calls.empty())
+    {
+        fail(*calls[0], "'call' is not allowed in a parallel loop");
+    }
+
+    if (!isCountedLoop(loop))
+    {
+        fail(loop, "parallel while must have the form 'while i < n ... let i = i + 1; endwhile'");
+    }
+
+    const std::string& counter = loop.expr->left->name;
+    const Expr& limit = *loop.expr->right;
+    for (const std::string& r : loop.reductions)
+    {
+        if (r == counter || (limit.kind == Expr::VARIABLE && r == limit.name))
+        {
+            fail(loop, "'" + r + "' controls the loop and cannot be a reduction");
+        }
+    }
+
+    size_t bodyEnd = loop.body.size() - 1;
+    std::set<std::string> assigned;
+    std::vector<std::pair<std::string, const Expr*>> accesses;
+    for (size_t k = 0; k < bodyEnd; k++)
+    {
+        checkParallelBody(loop, loop.body[k]);
+        assignedScalars(loop.body[k], assigned);
+        arrayAccesses(loop.body[k], accesses);
+    }
+
+    //anything else assigned is private to an iteration, so it must be
+    //written before it is read
+    for (const std::string& name : assigned)
+    {
+        if (std::find(loop.reductions.begin(), loop.reductions.end(), name) != loop.reductions.end())
+        {
+            continue;
+        }
+        for (size_t k = 0; k < bodyEnd; k++)
+        {
+            const Stmt& first = loop.body[k];
+            if (!assigns(first, name) && !reads(first, name))
+            {
+                continue;
+            }
+            if (first.kind != Stmt::LET || first.index || first.text != name || reads(*first.expr, name))
+            {
+                fail(first, "'" + name + "' carries a value between iterations of a parallel loop; "
+                            "assign it at the start of the loop or list it in reduce");
+            }
+            break;
+        }
+    }
+
+    //arrays written by the loop may only be used at the counter's element
+    std::set<std::string> written;
+    for (size_t k = 0; k < bodyEnd; k++)
+    {
+        writtenArrays(loop.body[k], written);
+    }
+    for (const auto& access : accesses)
+    {
+        const Expr& index = *access.second;
+        if (written.count(access.first) &&
+            (index.kind != Expr::VARIABLE || index.name != counter))
+        {
+            fail(loop, "array '" + access.first + "' is written in a parallel loop, so it may only be "
+                       "used as " + access.first + "[" + counter + "] there");
+        }
+    }
+}
+
+//reject statements with effects outside of their own iteration
+void Parser::checkParallelBody(const Stmt& loop, const Stmt& stmt) const
+{
+    auto fail = [&](const std::string& message) {
+        errorAt({"", "", stmt.line, stmt.col}, message);
+    };
+
+    switch (stmt.kind)
+    {
+    case Stmt::INPUT:
+        fail("'input' is not allowed in a parallel loop");
+        break;
+    case Stmt::PRINT_STRING:
+    case Stmt::PRINT_EXPR:
+        fail("'print' is not allowed in a parallel loop, output order would depend on thread timing");
+        break;
+    case Stmt::LABEL:
+    case Stmt::GOTO:
+        fail("labels and gotos are not allowed in a parallel loop");
+        break;
+    case Stmt::DIM:
+        fail("'dim' is not allowed in a parallel loop");
+        break;
+    case Stmt::WHILE:
+        if (stmt.parallel)
+        {
+            fail("parallel loops cannot be nested");
+        }
+        break;
+    default:
+        break;
+    }
+
+    //reductions are only touched by their own updates, all with the same operator
+    for (const std::string& r : loop.reductions)
+    {
+        std::string op = reductionOp(stmt, r);
+        if (!op.empty())
+        {
+            for (size_t k = 0; k + 1 < loop.body.size(); k++)
+            {
+                std::string other = firstReductionOp(loop.body[k], r);
+                if (!other.empty() && other != op)
+                {
+                    fail("reduction '" + r + "' mixes + and * updates");
+                }
+            }
+            continue;
+        }
+
+        bool touches = (stmt.kind == Stmt::LET && !stmt.index && stmt.text == r) ||
+                       (stmt.index && reads(*stmt.index, r)) ||
+                       (stmt.expr && reads(*stmt.expr, r));
+        if (touches)
+        {
+            fail("reduction '" + r + "' may only be updated as 'let " + r + " = " + r + " + ...' "
+                 "(or *) inside the parallel loop");
+        }
+    }
+
+    for (const Stmt& inner : stmt.body)
+    {
+        checkParallelBody(loop, inner);
+    }
+}
+
+// ---------------------------------------------
+// Name checks
+// ---------------------------------------------
+void Parser::useScalar(const Token& name)
+{
+    auto found = symbols.find(name.value);
+    if (found != symbols.end() && found->second.kind == Symbol::ARRAY)
+    {
+        errorAt(name, "'" + name.value + "' is an array, use " + name.value + "[index]");
+    }
+    if (found != symbols.end() && found->second.kind == Symbol::SUB)
+    {
+        errorAt(name, "'" + name.value + "' is a sub, use call " + name.value);
+    }
+    symbols.insert({name.value, {Symbol::SCALAR, statementIndex}});
+}
+
+void Parser::useArray(const Token& name)
+{
+    auto found = symbols.find(name.value);
+    if (found == symbols.end() || found->second.kind != Symbol::ARRAY)
+    {
+        errorAt(name, "Array '" + name.value + "' used before dim");
+    }
+}
+
+void Parser::declare(const Token& name, Symbol::Kind kind)
+{
+    if (symbols.count(name.value))
+    {
+        errorAt(name, "'" + name.value + "' is already declared");
+    }
+    symbols[name.value] = {kind, statementIndex};
+}
+
+// ---------------------------------------------
+// Expression node helpers
+// ---------------------------------------------
+ExprPtr Parser::makeUnary(const std::string& op, ExprPtr operand)
+{
+    ExprPtr e(new Expr());
+    e->kind = Expr::UNARY;
+    e->op = op;
+    e->left = std::move(operand);
+    return e;
+}
+
+ExprPtr Parser::makeBinary(const std::string& op, ExprPtr left, ExprPtr right)
+{
+    ExprPtr e(new Expr());
+    e->kind = Expr::BINARY;
+    e->op = op;
+    e->left = std::move(left);
+    e->right = std::move(right);
+    return e;
 }
 
 // ---------------------------------------------
 // Grammar rules for expressions
 // ---------------------------------------------
-std::string Parser::comparison()
+ExprPtr Parser::comparison()
 {
-    std::string left = expression();
+    ExprPtr left = expression();
 
     while (checkType("COMP"))
     {
         std::string op = currentToken().value;
         advance();
-        std::string right = expression();
-        left = "(" + left + " " + op + " " + right + ")";
+        ExprPtr right = expression();
+        left = makeBinary(op, std::move(left), std::move(right));
     }
 
     return left;
 }
 
-std::string Parser::expression()
+ExprPtr Parser::expression()
 {
-    std::string left = term();
+    ExprPtr left = term();
 
     while (checkType("PLUS") || checkType("MINUS"))
     {
         std::string op = currentToken().type == "PLUS" ? "+" : "-";
         advance();
-        std::string right = term();
-        left = "(" + left + " " + op + " " + right + ")";
+        ExprPtr right = term();
+        left = makeBinary(op, std::move(left), std::move(right));
     }
 
     return left;
 }
 
-std::string Parser::term()
+ExprPtr Parser::term()
 {
-    std::string left = unary();
+    ExprPtr left = unary();
 
     while (checkType("TIMES") || checkType("DIVIDE"))
     {
         std::string op = currentToken().type == "TIMES" ? "*" : "/";
         advance();
-        std::string right = unary();
-        left = "(" + left + " " + op + " " + right + ")";
+        ExprPtr right = unary();
+        left = makeBinary(op, std::move(left), std::move(right));
     }
 
     return left;
 }
 
-std::string Parser::unary()
+ExprPtr Parser::unary()
 {
     if (checkType("PLUS"))
     {
@@ -312,43 +719,68 @@ std::string Parser::unary()
     if (checkType("MINUS"))
     {
         advance();
-        return "(-" + unary() + ")";
+        return makeUnary("-", unary());
     }
 
     if (checkType("NOT"))
     {
         advance();
-        return "(!" + unary() + ")";
+        return makeUnary("!", unary());
     }
 
     return primary();
 }
 
-std::string Parser::primary()
+ExprPtr Parser::primary()
 {
     if (checkType("INTEGER"))
     {
-        std::string value = currentToken().value;
+        ExprPtr e(new Expr());
+        e->kind = Expr::NUMBER;
+        try
+        {
+            e->value = std::stoi(currentToken().value);
+        }
+        catch (const std::out_of_range&)
+        {
+            error("Integer literal out of range: " + currentToken().value);
+        }
         advance();
-        return value;
+        return e;
     }
 
     if (checkType("IDENT"))
     {
-        std::string name = currentToken().value;
-        emitter.ensureVar(name);
+        const Token& name = currentToken();
+        ExprPtr e(new Expr());
+        e->kind = Expr::VARIABLE;
+        e->name = name.value;
         advance();
-        return name;
+
+        // name[index]
+        if (checkType("LBRACKET"))
+        {
+            useArray(name);
+            advance();
+            e->kind = Expr::INDEX;
+            e->left = comparison();
+            expectType("RBRACKET", "array subscript");
+        }
+        else
+        {
+            useScalar(name);
+        }
+        return e;
     }
 
     if (checkType("LPAREN"))
     {
         advance();
-        std::string inside = comparison();
+        ExprPtr inside = comparison();
         expectType("RPAREN", "closing parenthesis");
-        return "(" + inside + ")";
+        return inside;
     }
 
     error("Expected expression");
-    return "";
+    return nullptr;
 }
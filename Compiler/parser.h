@@ -1,22 +1,56 @@
 #pragma once
+#include <deque>
+#include <functional>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include "token.h"
-#include "emitter.h"
+#include "ast.h"
+
+//a name is a scalar, an array or a sub, first used in top-level statement 'statement'
+struct Symbol
+{
+    enum Kind { SCALAR, ARRAY, SUB };
+
+    Kind kind;
+    size_t statement;
+};
+using SymbolTable = std::unordered_map<std::string, Symbol>;
 
 class Parser
 {
 public:
-    Parser(const std::vector<Token>& tokenList, Emitter& emitterInstance);
+    //parses tokenList in place, it is not copied and must outlive the parser
+    explicit Parser(const std::vector<Token>& tokenList);
+    Parser(std::vector<Token>&&) = delete;
+
+    //tokens are pulled from next as the parse needs them, up to EOF
+    explicit Parser(std::function<Token()> next);
 
     //entry point
-    void parseProgram();
+    Program parseProgram();
+
+    //parse as if the tokens followed firstStatement top-level statements that declared symbols
+    void resume(SymbolTable symbols, size_t firstStatement);
+
+    //names seen so far, and the token index where each top-level statement started
+    SymbolTable& symbolTable() { return symbols; }
+    const std::vector<size_t>& statementStarts() const { return starts; }
 
 private:
-    //token stream
-    std::vector<Token> tokens;
+    //token stream: the caller's vector, or the tokens pulled so far, kept in a
+    //deque so that references to them stay valid while more are pulled in
+    const std::vector<Token>* list = nullptr;
+    std::deque<Token> pulled;
     size_t currentIndex;
-    Emitter& emitter;
+    std::function<Token()> pull;
+
+    const Token& tokenAt(size_t index) const { return list ? (*list)[index] : pulled[index]; }
+    size_t tokenCount() const { return list ? list->size() : pulled.size(); }
+
+    SymbolTable symbols;
+    size_t statementIndex = 0; //top-level statement being parsed
+    std::vector<size_t> starts;
 
     //functions
     const Token& currentToken() const;
@@ -26,12 +60,25 @@ private:
     void advance();
     void expectType(const std::string& type, const std::string& context);
     void error(const std::string& message) const;
+    void errorAt(const Token& token, const std::string& message) const;
+
+    //name checks
+    void useScalar(const Token& name);
+    void useArray(const Token& name);
+    void declare(const Token& name, Symbol::Kind kind);
 
     //grammar rules
-    void statement();
-    std::string comparison();
-    std::string expression();
-    std::string term();
-    std::string unary();
-    std::string primary();
+    Stmt subroutine();
+    Stmt statement();
+    void target(Stmt& stmt, const std::string& context);
+    void checkParallel(const Stmt& loop) const;
+    void checkParallelBody(const Stmt& loop, const Stmt& stmt) const;
+    ExprPtr comparison();
+    ExprPtr expression();
+    ExprPtr term();
+    ExprPtr unary();
+    ExprPtr primary();
+
+    static ExprPtr makeUnary(const std::string& op, ExprPtr operand);
+    static ExprPtr makeBinary(const std::string& op, ExprPtr left, ExprPtr right);
 };
@@ -0,0 +1,101 @@
+#include "pipeline.h"
+#include "lexer.h"
+#include "parser.h"
+
+//tokens per batch, and batches in flight; enough to keep both threads busy
+//without the lexer running far ahead on a huge source
+static const size_t BATCH_TOKENS = 4096;
+static const size_t RING_BATCHES = 64;
+
+TokenPipeline::TokenPipeline(const std::string& text)
+    : source(text), ring(RING_BATCHES)
+{
+    lexerThread = std::thread(&TokenPipeline::produce, this);
+}
+
+TokenPipeline::~TokenPipeline()
+{
+    //the consumer may give up early (parse error), unblock the lexer
+    stopping.store(true, std::memory_order_relaxed);
+    lexerThread.join();
+}
+
+//lexer thread
+void TokenPipeline::produce()
+{
+    Lexer lexer(source);
+    Batch batch;
+    bool last = false;
+    while (!last)
+    {
+        batch.tokens.reserve(BATCH_TOKENS);
+        try
+        {
+            while (batch.tokens.size() < BATCH_TOKENS && !last)
+            {
+                batch.tokens.push_back(lexer.nextToken());
+                last = batch.tokens.back().type == "EOF";
+            }
+        }
+        catch (...)
+        {
+            batch.error = std::current_exception();
+            last = true;
+        }
+
+        while (!ring.tryPush(batch))
+        {
+            if (stopping.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        batch = Batch();
+    }
+}
+
+Token TokenPipeline::next()
+{
+    while (position == current.tokens.size())
+    {
+        if (current.error)
+        {
+            finished = true;
+            std::rethrow_exception(current.error);
+        }
+        while (!ring.tryPop(current))
+        {
+            std::this_thread::yield();
+        }
+        position = 0;
+    }
+
+    Token token = std::move(current.tokens[position++]);
+    finished = token.type == "EOF";
+    return token;
+}
+
+void TokenPipeline::drain()
+{
+    while (!finished)
+    {
+        next();
+    }
+}
+
+Program parsePipelined(const std::string& source)
+{
+    TokenPipeline pipeline(source);
+    Parser parser([&pipeline]() { return pipeline.next(); });
+    try
+    {
+        return parser.parseProgram();
+    }
+    catch (...)
+    {
+        //run one after the other, the lexer error would have come first
+        pipeline.drain();
+        throw;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ast.h"
+#include "ring.h"
+#include "token.h"
+
+//lexes source on a thread of its own and hands the tokens over in batches,
+//so the parser can start before the whole source is lexed
+class TokenPipeline
+{
+public:
+    explicit TokenPipeline(const std::string& source); //not copied, must outlive the pipeline
+    ~TokenPipeline();
+
+    TokenPipeline(const TokenPipeline&) = delete;
+    TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+    //tokens in source order, ending with EOF; a lexer error is rethrown here
+    //where Lexer::nextToken would have thrown it
+    Token next();
+
+    //read up to EOF, rethrowing a lexer error on the way
+    void drain();
+
+private:
+    struct Batch
+    {
+        std::vector<Token> tokens;
+        std::exception_ptr error;   //set on the last batch when the lexer failed
+    };
+
+    const std::string& source;
+    SpscRing<Batch> ring;
+    std::atomic<bool> stopping{false};
+    std::thread lexerThread;
+
+    Batch current;
+    size_t position = 0;
+    bool finished = false;      //EOF or the error was handed out
+
+    void produce();
+};
+
+//same result and errors as Lexer::tokenize followed by Parser::parseProgram,
+//with the two running on separate threads
+Program parsePipelined(const std::string& source);
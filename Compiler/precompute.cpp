@@ -0,0 +1,102 @@
+#include "precompute.h"
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include "ir.h"
+#include "executor.h"
+#include "analysis.h"
+
+//programs printing more than this keep computing their output at run time
+static const size_t MAX_OUTPUT = 1 << 20;
+
+//run the first count statements; false if they did not finish within the budget
+static bool evaluate(const Program& program, size_t count, uint64_t stepBudget, Precomputed& result)
+{
+    Module module = lowerPrefix(program, count);
+    std::vector<char> bytes = module.serialize();
+    ModuleView view = parseModule(bytes.data(), bytes.size());
+    RunState state(view);
+
+    char* buffer = nullptr;
+    size_t length = 0;
+    FILE* out = open_memstream(&buffer, &length);
+    if (out == nullptr)
+    {
+        return false;
+    }
+
+    RunStatus status;
+    try
+    {
+        status = run(view, state, nullptr, out, stepBudget);
+    }
+    catch (const std::runtime_error&)
+    {
+        //e.g. division by zero or a bad index, leave it to fail at run time
+        status = RunStatus::INPUT_ERROR;
+    }
+    std::fclose(out);
+
+    bool finished = status == RunStatus::HALTED && length <= MAX_OUTPUT;
+    if (finished)
+    {
+        result.statementCount = count;
+        result.output.assign(buffer, length);
+        result.variables.clear();
+        for (size_t i = 0; i < module.variables.size(); i++)
+        {
+            result.variables[module.variables[i]] = state.vars[i];
+        }
+        result.arrays.clear();
+        for (size_t i = 0; i < module.arrays.size(); i++)
+        {
+            result.arrays[module.arrays[i].first].assign(state.arrays[i].begin(), state.arrays[i].end());
+        }
+    }
+    std::free(buffer);
+    return finished;
+}
+
+Precomputed precomputeProgram(const Program& program, uint64_t stepBudget)
+{
+    Precomputed result;
+    const std::vector<Stmt>& statements = program.statements;
+
+    bool readsInput = false;
+    for (const Stmt& stmt : statements)
+    {
+        readsInput = readsInput || contains(stmt, {Stmt::INPUT});
+    }
+
+    //a program without input is fully determined, gotos and all
+    if (!readsInput && evaluate(program, statements.size(), stepBudget, result))
+    {
+        return result;
+    }
+
+    //otherwise only an input-free prefix that no goto can jump into or out of
+    size_t limit = 0;
+    while (limit < statements.size() &&
+           !contains(statements[limit], {Stmt::INPUT, Stmt::LABEL, Stmt::GOTO}))
+    {
+        limit++;
+    }
+
+    //longer prefixes only ever need more steps, so search for the longest that fits
+    size_t low = 0, high = limit;
+    while (low < high)
+    {
+        size_t mid = low + (high - low + 1) / 2;
+        if (evaluate(program, mid, stepBudget, result))
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    return result;
+}
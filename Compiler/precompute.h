@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+
+//leading statements of a program evaluated at compile time
+struct Precomputed
+{
+    size_t statementCount = 0;  //top-level statements that no longer need to run
+    std::string output;         //everything they printed
+    std::unordered_map<std::string, int> variables; //values they left behind
+    std::unordered_map<std::string, std::vector<int>> arrays;
+};
+
+//evaluate as much of the program as does not depend on input
+//stepBudget bounds loop iterations and gotos so runaway loops are left to run time
+Precomputed precomputeProgram(const Program& program, uint64_t stepBudget);
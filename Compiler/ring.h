@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//bounded queue between exactly one producer thread and one consumer thread,
+//without locks: each side only ever writes its own index
+template <typename T>
+class SpscRing
+{
+public:
+    //capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    //producer only: move value in, false (value untouched) when full
+    bool tryPush(T& value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == slots.size())
+        {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == slots.size())
+            {
+                return false;
+            }
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //consumer only: move the oldest value out, false when empty
+    bool tryPop(T& value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache)
+        {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache)
+            {
+                return false;
+            }
+        }
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    //free-running counts of pops and pushes, on separate cache lines so the
+    //two threads do not keep stealing each other's line
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tailCache = 0;   //consumer's last look at tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t headCache = 0;   //producer's last look at head
+};
@@ -0,0 +1,199 @@
+#include "runtime.h"
+
+//no libc at all: every call the generated code makes is defined here, and
+//the only symbols gcc may still reference on its own are memcpy/memset
+static const char RUNTIME[] = R"(//freestanding runtime, build with: gcc -O2 -static -nostdlib -fno-stack-protector prog.c
+#if defined(__x86_64__)
+#define BASIC_SYS_READ 0
+#define BASIC_SYS_WRITE 1
+#define BASIC_SYS_EXIT_GROUP 231
+
+static long basic_syscall(long n, long a, long b, long c)
+{
+    long ret;
+    __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+    return ret;
+}
+
+//the kernel leaves rsp 16-byte aligned, a call expects it 8 off
+__asm__(".text\n.globl _start\n_start:\n\txor %ebp, %ebp\n\tmov %rsp, %rdi\n\tand $-16, %rsp\n\tcall basic_start\n\thlt\n");
+#elif defined(__aarch64__)
+#define BASIC_SYS_READ 63
+#define BASIC_SYS_WRITE 64
+#define BASIC_SYS_EXIT_GROUP 94
+
+static long basic_syscall(long n, long a, long b, long c)
+{
+    register long x8 __asm__("x8") = n;
+    register long x0 __asm__("x0") = a;
+    register long x1 __asm__("x1") = b;
+    register long x2 __asm__("x2") = c;
+    __asm__ volatile ("svc 0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2) : "memory");
+    return x0;
+}
+
+__asm__(".text\n.globl _start\n_start:\n\tmov x29, #0\n\tmov x30, #0\n\tmov x0, sp\n\tbl basic_start\n");
+#else
+#error "freestanding programs support x86_64 and aarch64 only"
+#endif
+
+#define BASIC_EINTR 4
+
+//gcc may turn loops and copies into these even without libc
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+void* memcpy(void* dest, const void* src, unsigned long n)
+{
+    char* d = dest;
+    const char* s = src;
+    while (n--) *d++ = *s++;
+    return dest;
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+void* memset(void* dest, int c, unsigned long n)
+{
+    char* d = dest;
+    while (n--) *d++ = (char)c;
+    return dest;
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static long basic_length(const char* s)
+{
+    long n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static char basic_out[8192];
+static long basic_out_len;
+static char basic_in[8192];
+static long basic_in_pos, basic_in_len;
+
+static void basic_write_all(int fd, const char* p, long n)
+{
+    while (n > 0)
+    {
+        long written = basic_syscall(BASIC_SYS_WRITE, fd, (long)p, n);
+        if (written == -BASIC_EINTR) continue;
+        if (written < 0) return;
+        p += written;
+        n -= written;
+    }
+}
+
+static void basic_flush(void)
+{
+    basic_write_all(1, basic_out, basic_out_len);
+    basic_out_len = 0;
+}
+
+static void __attribute__((noreturn)) basic_exit(int code)
+{
+    basic_flush();
+    for (;;) basic_syscall(BASIC_SYS_EXIT_GROUP, code, 0, 0);
+}
+
+static void __attribute__((noreturn, cold)) basic_fail(const char* message)
+{
+    basic_write_all(2, message, basic_length(message));
+    basic_exit(1);
+}
+
+//stdout is buffered like stdio's, and flushed on exit and before blocking on input
+static void __attribute__((unused)) basic_write(const char* p, long n)
+{
+    if (n > (long)sizeof(basic_out) - basic_out_len)
+    {
+        basic_flush();
+        if (n >= (long)sizeof(basic_out))
+        {
+            basic_write_all(1, p, n);
+            return;
+        }
+    }
+    for (long i = 0; i < n; i++) basic_out[basic_out_len + i] = p[i];
+    basic_out_len += n;
+}
+
+static void __attribute__((unused)) basic_print_str(const char* s)
+{
+    basic_write(s, basic_length(s));
+    basic_write("\n", 1);
+}
+
+static void __attribute__((unused)) basic_print_int(int value)
+{
+    char buf[12];
+    char* p = buf + sizeof(buf);
+    unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    *--p = '\n';
+    do { *--p = (char)('0' + u % 10); u /= 10; } while (u);
+    if (value < 0) *--p = '-';
+    basic_write(p, buf + sizeof(buf) - p);
+}
+
+//next input byte without consuming it, -1 at end of input
+static int basic_peek(void)
+{
+    if (basic_in_pos == basic_in_len)
+    {
+        long n;
+        basic_flush();
+        do n = basic_syscall(BASIC_SYS_READ, 0, (long)basic_in, sizeof(basic_in)); while (n == -BASIC_EINTR);
+        if (n <= 0) return -1;
+        basic_in_pos = 0;
+        basic_in_len = n;
+    }
+    return (unsigned char)basic_in[basic_in_pos];
+}
+
+//same as scanf("%d"): skip whitespace, optional sign, at least one digit
+static void __attribute__((unused)) basic_input(int* target)
+{
+    int c, negative = 0;
+    unsigned int u = 0;
+    while ((c = basic_peek()) == ' ' || (c >= '\t' && c <= '\r')) basic_in_pos++;
+    if (c == '-' || c == '+')
+    {
+        negative = c == '-';
+        basic_in_pos++;
+        c = basic_peek();
+    }
+    if (c < '0' || c > '9') basic_fail("Input error\n");
+    while ((c = basic_peek()) >= '0' && c <= '9')
+    {
+        u = u * 10 + (unsigned int)(c - '0');
+        basic_in_pos++;
+    }
+    *target = (int)(negative ? 0u - u : u);
+}
+
+//_start hands over the initial stack: argc, then the argv pointers
+#ifdef BASIC_MAIN_ARGS
+int main(int argc, char** argv);
+
+static void __attribute__((used, noreturn)) basic_start(long* stack)
+{
+    basic_exit(main((int)stack[0], (char**)(stack + 1)));
+}
+#else
+int main(void);
+
+static void __attribute__((used, noreturn)) basic_start(void)
+{
+    basic_exit(main());
+}
+#endif)";
+
+const std::string& freestandingRuntime()
+{
+    static const std::string runtime = RUNTIME;
+    return runtime;
+}
+
+const std::vector<std::string>& freestandingFlags()
+{
+    static const std::vector<std::string> flags = {"-O2", "-static", "-nostdlib", "-fno-stack-protector"};
+    return flags;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#include <vector>
+
+//C source of the runtime used instead of libc by freestanding programs:
+//_start, raw read/write/exit syscalls, buffered output and integer parsing
+const std::string& freestandingRuntime();
+
+//gcc flags a freestanding program has to be built with
+const std::vector<std::string>& freestandingFlags();
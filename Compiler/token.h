@@ -6,4 +6,6 @@ struct Token{
     std::string type; //token type
     int line; //line number in source
     int col; //column number in source
+    size_t offset = 0; //byte range in source
+    size_t length = 0;
 };
@@ -0,0 +1,190 @@
+#include "watch.h"
+#include <iostream>
+#include <set>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//how long to wait for more events before compiling a batch (ms)
+static const int SETTLE_MS = 50;
+
+static bool isBasicFile(const std::string& name)
+{
+    const std::string suffix = ".basic";
+    return name.length() > suffix.length() &&
+           name.compare(name.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+//true when path.c is missing or older than path
+static bool isStale(const std::string& path)
+{
+    struct stat src, out;
+    if (stat(path.c_str(), &src) != 0)
+    {
+        return false;
+    }
+    if (stat((path + ".c").c_str(), &out) != 0)
+    {
+        return true;
+    }
+    return out.st_mtim.tv_sec < src.st_mtim.tv_sec ||
+           (out.st_mtim.tv_sec == src.st_mtim.tv_sec && out.st_mtim.tv_nsec < src.st_mtim.tv_nsec);
+}
+
+//start gcc on path.c in the background, binary is path without .basic
+static pid_t startBuild(const std::string& path, const std::vector<std::string>& flags)
+{
+    std::string cFile = path + ".c";
+    std::string binary = path.substr(0, path.length() - 6);
+
+    std::vector<const char*> argv = {"gcc", cFile.c_str()};
+    for (const std::string& flag : flags)
+    {
+        argv.push_back(flag.c_str());
+    }
+    argv.push_back("-o");
+    argv.push_back(binary.c_str());
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execvp("gcc", (char* const*)argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+//transpile every file in the batch, then run the gcc builds side by side
+static void compileBatch(const std::set<std::string>& batch, const CompileFn& compile, bool build,
+                         const std::vector<std::string>& flags)
+{
+    std::vector<std::pair<pid_t, std::string>> builds;
+
+    for (const std::string& path : batch)
+    {
+        if (!compile(path) || !build)
+        {
+            continue;
+        }
+        pid_t pid = startBuild(path, flags);
+        if (pid < 0)
+        {
+            std::cerr << "Error: Could not start gcc for " << path << std::endl;
+            continue;
+        }
+        builds.push_back({pid, path});
+    }
+
+    for (const auto& b : builds)
+    {
+        int status = 0;
+        waitpid(b.first, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            std::cout << "Built: " << b.second.substr(0, b.second.length() - 6) << std::endl;
+        }
+        else
+        {
+            std::cerr << "Error: gcc failed for " << b.second << ".c" << std::endl;
+        }
+    }
+}
+
+int watchDirectory(const std::string& dir, const CompileFn& compile, bool build,
+                   const std::vector<std::string>& gccFlags)
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cerr << "Error: inotify_init1: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    //editors either rewrite in place or rename a temp file over the original
+    if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        std::cerr << "Error: Could not watch directory " << dir << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    std::string prefix = dir;
+    if (prefix.empty() || prefix.back() != '/')
+    {
+        prefix.push_back('/');
+    }
+
+    //catch up on anything edited while we were not running
+    std::set<std::string> batch;
+    if (DIR* d = opendir(dir.c_str()))
+    {
+        while (struct dirent* entry = readdir(d))
+        {
+            std::string path = prefix + entry->d_name;
+            if (isBasicFile(entry->d_name) && isStale(path))
+            {
+                batch.insert(path);
+            }
+        }
+        closedir(d);
+    }
+    compileBatch(batch, compile, build, gccFlags);
+
+    std::cout << "Watching " << dir << " for changes..." << std::endl;
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (true)
+    {
+        batch.clear();
+
+        //block for the first event, then keep draining until the directory settles
+        int timeout = -1;
+        while (true)
+        {
+            struct pollfd p = {fd, POLLIN, 0};
+            int ready = poll(&p, 1, timeout);
+            if (ready < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ready < 0)
+            {
+                std::cerr << "Error: poll: " << std::strerror(errno) << std::endl;
+                close(fd);
+                return 1;
+            }
+            if (ready == 0)
+            {
+                break;
+            }
+
+            ssize_t len = read(fd, buffer, sizeof(buffer));
+            if (len <= 0)
+            {
+                break;
+            }
+            for (char* ptr = buffer; ptr < buffer + len;)
+            {
+                struct inotify_event* event = (struct inotify_event*)ptr;
+                if (event->len > 0 && isBasicFile(event->name))
+                {
+                    batch.insert(prefix + event->name);
+                }
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+            timeout = SETTLE_MS;
+        }
+
+        compileBatch(batch, compile, build, gccFlags);
+    }
+
+    close(fd);
+    return 0;
+}
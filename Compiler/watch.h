@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <vector>
+
+//transpiles one .basic file, returns false on error
+using CompileFn = std::function<bool(const std::string& inputPath)>;
+
+//watch dir with inotify and re-transpile .basic files as they change
+//build also runs gcc, with gccFlags, on every file that transpiled cleanly
+int watchDirectory(const std::string& dir, const CompileFn& compile, bool build,
+                   const std::vector<std::string>& gccFlags);